@@ -0,0 +1,157 @@
+#ifndef ENVIRONMENT_H_
+#define ENVIRONMENT_H_
+
+// the environment of a generation: the stimulus increase (delta) of
+// every task at every timestep, a stochastic sine wave (Botero et al.
+// 2015 PNAS 112: 184-189)
+//
+//      delta = baseline + A * sin(2 pi t / maxtime * genspercycle) + B * u
+//
+// where t counts the timesteps since the start of the run and u is
+// uniform in (-1,1). The whole table of a generation is generated at
+// once, before any colony is simulated, and then only read, so that
+// all colonies and threads share the same environment. The sine only
+// depends on the timestep and is evaluated once per timestep; the
+// noise of a generation comes from a single stream (seed,
+// ENVIRONMENT_RNG_PURPOSE, generation, 0) of which all words are
+// generated at once (see philox_fill): the noise of task i at
+// timestep k is word k * tasks + i.
+//
+// tables can be written to a file and read back (environment_write,
+// environment_read), so that runs can be compared in exactly the
+// same environment
+
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include "philox.h"
+
+// purpose of the stream of the noise (see philox_rng_set); the 
+// models' other streams should use other purposes
+const uint32_t ENVIRONMENT_RNG_PURPOSE = 5;
+
+struct environment
+{
+    int tasks;
+    int steps; // timesteps per generation
+    int generation; // generation of the table
+
+    // delta of task i at timestep k is delta[k * tasks + i]
+    std::vector < double > delta;
+
+    std::vector < double > wave; // sine part of each timestep
+    std::vector < uint32_t > noise; // random words of the noise
+};
+
+// delta at timestep k of the table
+inline const double * environment_step(const environment & env, int k)
+{
+    return &env.delta[k * env.tasks];
+}
+
+// generate the environment of a generation, with maxtime timesteps
+// and a baseline for each of the tasks
+inline void environment_generate(environment & env,
+        const std::vector < double > & baseline,
+        double A,
+        double B,
+        int maxtime,
+        double genspercycle,
+        uint32_t seed,
+        int generation)
+{
+    int tasks = baseline.size();
+
+    env.tasks = tasks;
+    env.steps = maxtime;
+    env.generation = generation;
+    env.delta.resize(maxtime * tasks);
+    env.wave.resize(maxtime);
+    env.noise.resize(maxtime * tasks);
+
+    for (int k = 0; k < maxtime; ++k)
+    {
+        // timesteps since the start of the run
+        double t = (double) maxtime * generation + k;
+
+        env.wave[k] = A * sin((2 * M_PI * t) / maxtime * genspercycle);
+    }
+
+    philox_rng rng_environment;
+    philox_rng_set(rng_environment, seed, ENVIRONMENT_RNG_PURPOSE, generation, 0);
+    philox_fill(rng_environment, &env.noise[0], env.noise.size());
+
+    for (int k = 0; k < maxtime; ++k)
+    {
+        for (int task_i = 0; task_i < tasks; ++task_i)
+        {
+            // uniform number in (-1,1), cf. philox_rng_uniform_pos
+            double u = (env.noise[k * tasks + task_i] + 0.5) / 2147483648.0 - 1;
+
+            env.delta[k * tasks + task_i] = baseline[task_i] + env.wave[k] + B * u;
+        }
+    }
+}
+
+// write a table, one line per timestep:
+// generation, timestep and the delta of every task
+// (with enough digits to read back the exact values)
+inline void environment_write(std::ostream & out, const environment & env)
+{
+    std::streamsize precision = out.precision(17);
+
+    for (int k = 0; k < env.steps; ++k)
+    {
+        out << env.generation << "\t" << k;
+
+        for (int task_i = 0; task_i < env.tasks; ++task_i)
+        {
+            out << "\t" << env.delta[k * env.tasks + task_i];
+        }
+
+        out << "\n";
+    }
+
+    out.precision(precision);
+}
+
+// read the table of a generation with the given number of tasks and
+// timesteps from a file written by environment_write, continuing where
+// the previous read stopped. Returns false if the file ends or the
+// next table is not the one of this generation
+inline bool environment_read(std::istream & in,
+        environment & env,
+        int tasks,
+        int maxtime,
+        int generation)
+{
+    env.tasks = tasks;
+    env.steps = maxtime;
+    env.generation = generation;
+    env.delta.resize(maxtime * tasks);
+
+    for (int k = 0; k < maxtime; ++k)
+    {
+        int file_generation, file_step;
+
+        if (!(in >> file_generation >> file_step)
+                || file_generation != generation
+                || file_step != k)
+        {
+            return false;
+        }
+
+        for (int task_i = 0; task_i < tasks; ++task_i)
+        {
+            if (!(in >> env.delta[k * tasks + task_i]))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+#endif
@@ -9,11 +9,14 @@
 #include <stdlib.h>
 #include <fstream>
 #include <cassert>
+#include <climits>
 #include <algorithm>
-#include <gsl/gsl_rng.h>
-#include <gsl/gsl_randist.h>
 #include <sys/stat.h>
 #include <sstream>
+#include <omp.h>
+#include "philox.h"
+#include "random_buffer.h"
+#include "environment.h"
 
 //#define DEBUG
 //#define SIMULTANEOUS_UPDATE
@@ -22,10 +25,27 @@
 
 using namespace std;
 
-// random number generator 
-// see http://www.gnu.org/software/gsl/manual/html_node/Random-Number-Generation.html#Random-Number-Generation 
-gsl_rng_type const * T; // gnu scientific library rng type
-gsl_rng *rng_global; // gnu scientific rng 
+// random number generators
+// all random numbers come from counter-based streams (see philox.h),
+// one for every (seed, purpose, generation, unit) so that colonies
+// can be simulated in parallel and results do not depend on the 
+// number of threads
+enum Rng_Purpose
+{
+    RNG_WORKERS = 1, // inheritance of the workers of a colony
+    RNG_ECOLOGY, // task choice, quitting, switching and order of the workers of a colony
+    RNG_REPRODUCTION, // pairing of sexuals into new colonies
+    RNG_SEXUALS, // production of sexuals, one stream per sexual
+    RNG_ENVIRONMENT = ENVIRONMENT_RNG_PURPOSE // noise of the environment, one stream per generation (see environment.h)
+};
+
+// number of threads that simulate colonies, see Init_Run_Options
+int num_threads;
+
+// files to which the environment of every generation is written, 
+// or from which it is read instead of generating it (see Init_Run_Options)
+string environment_save_file;
+string environment_replay_file;
 
 
 struct Params
@@ -79,7 +99,6 @@ struct Params
 	double genspercycle; //Generations per environmental cycle
 	double randommax; //Maximum value of positive random number
 	int gensdone; //Generations completed
-	int stepsdone; //Timesteps completed in current generation
   
 
     // function to initialize the parameters from the parameter
@@ -108,9 +127,18 @@ typedef vector <Ant> Sexuals;
 struct Colony
 {
     Workers MyAnts; // stack of workers
+    vector <int> order; // order in which the workers are visited, reshuffled every timestep
     Ant male, queen; // queen and her male
     int ID; // unique ID of the colony
 
+    // random numbers for the behaviour of the workers in this 
+    // generation, so that colonies do not share a stream; buffered
+    // (see random_buffer.h), see Init for the sizes of the buffers
+    philox_buffer rng_ecology;
+
+    // scratch space for Inherit_Workers
+    vector < uint32_t > inherit_words;
+
     vector<double> stim; // stimulus level at time t for each task
     vector<double> newstim; // stimulus level at time t+1 for each task
     vector<double> workfor;  // number acts * eff each time step
@@ -373,11 +401,11 @@ void InitFounders(Population &Pop, Params &Par)
 }// end InitFounders
 
 // mutation of a single threshold allele
-double Mutate(double val, double mu, double mustd)
+double Mutate(double val, double mu, double mustd, philox_rng & rng_r)
 {
-    if (gsl_rng_uniform(rng_global) < mu)
+    if (philox_rng_uniform(rng_r) < mu)
     {
-        val += gsl_ran_gaussian(rng_global, mustd);
+        val += philox_ran_gaussian(rng_r, mustd);
     }
 
     // thresholds cannot be <0 
@@ -389,14 +417,13 @@ double Mutate(double val, double mu, double mustd)
     return(val);
 }
 
-
-// Defines inheritance, producing worker 
-// threshold genotypes from their parents, 
-// including mutation
-void Inherit(Ant &Daughter, Ant &Mom, Ant &Dad, Params &Par)
+// Defines inheritance, producing threshold 
+// genotypes from their parents, including mutation
+// (for the workers of a colony, see Inherit_Workers)
+void Inherit(Ant &Daughter, Ant &Mom, Ant &Dad, Params &Par, philox_rng & rng_r)
 {
     // start with inheritance from mom (true) or from dad (false)
-    bool inherit_from_mom = gsl_rng_uniform(rng_global) < 0.5;
+    bool inherit_from_mom = philox_rng_uniform(rng_r) < 0.5;
 
     double allelic_value;
 
@@ -409,7 +436,7 @@ void Inherit(Ant &Daughter, Ant &Mom, Ant &Dad, Params &Par)
         {
             // ok recombination happened, hence change parent 
             // from which the next allele will originate
-            if (gsl_rng_uniform(rng_global) < Par.recomb)
+            if (philox_rng_uniform(rng_r) < Par.recomb)
             {
                 inherit_from_mom = !inherit_from_mom;
             }
@@ -419,29 +446,93 @@ void Inherit(Ant &Daughter, Ant &Mom, Ant &Dad, Params &Par)
         allelic_value = inherit_from_mom ? Mom.threshold[task] : Dad.threshold[task];
 
         // mutate it
-        allelic_value = Mutate(allelic_value, Par.mutp, Par.mutstd);
+        allelic_value = Mutate(allelic_value, Par.mutp, Par.mutstd, rng_r);
 
         // assign it to daughter
         Daughter.threshold[task] = allelic_value;
     }
 } // end of Inherit
 
+// the thresholds of all workers of a colony, inherited from its 
+// founders as in Inherit, but for all workers at once (mutations
+// follow in Mutate_Workers): the parent of each locus is derived 
+// from random words generated in bulk, one per locus of each worker.
+// The first word of a worker chooses the parent of her first locus,
+// each next one whether recombination changes the parent before 
+// the next locus
+void Inherit_Workers(Colony & Col, Params & Par, philox_rng & rng_r)
+{
+    Col.inherit_words.resize(Col.MyAnts.size() * Par.tasks);
+    philox_fill(rng_r, &Col.inherit_words[0], Col.inherit_words.size());
+
+    // thresholds of dad (0) and mom (1)
+    const double * parents[2] = { 
+        &Col.male.threshold[0], 
+        &Col.queen.threshold[0] };
+
+    for (unsigned int ant_i = 0; ant_i < Col.MyAnts.size(); ++ant_i)
+    {
+        const uint32_t * words = &Col.inherit_words[ant_i * Par.tasks];
+        double * threshold = &Col.MyAnts[ant_i].threshold[0];
+
+        // each parent with probability 0.5
+        int from_mom = words[0] < 2147483648u;
+
+        threshold[0] = parents[from_mom][0];
+
+        for (int task = 1; task < Par.tasks; ++task)
+        {
+            from_mom ^= words[task] / 4294967296.0 < Par.recomb;
+
+            threshold[task] = parents[from_mom][task];
+        }
+    }
+}
 
-// Initialises the ant workers, as generated by the Inherit function
-// Prints their threshold variables, and puts them to work on a task depending on their inherited thresholds
-void InitAnts(Ant & myAnt, Params & Par, Colony & myCol)
+// mutate the thresholds of all workers of a colony at once, as
+// Mutate would do for each of them: rather than drawing a random
+// number per threshold to decide whether it mutates, draw the number
+// of thresholds skipped before the next mutation (geometrically 
+// distributed), going through all thresholds of all workers in turn
+void Mutate_Workers(Colony & Col, Params & Par, philox_rng & rng_r)
 {
-    // allocate space for the thresholds
-    myAnt.threshold.resize(Par.tasks);
+    long num_alleles = Col.MyAnts.size() * Par.tasks;
 
-    if (Par.maxgen > 1)
+    for (long allele_i = -1;;)
     {
-        // inherit from mom and dad
-        Inherit(myAnt, myCol.queen, myCol.male, Par);
+        long skip = geometric_skip(Par.mutp, philox_rng_uniform_pos(rng_r));
+
+        if (skip >= num_alleles - allele_i - 1)
+        {
+            break;
+        }
+
+        allele_i += skip + 1;
+
+        double & threshold = 
+            Col.MyAnts[allele_i / Par.tasks].threshold[allele_i % Par.tasks];
+
+        threshold += philox_ran_gaussian(rng_r, Par.mutstd);
+
+        // thresholds cannot be <0 
+        if (threshold < 0)
+        {
+            threshold = 0;
+        }
     }
-    else 
+}
+
+
+// Initialises the ant workers; their thresholds are inherited from 
+// the founders for all workers at once in Init (see Inherit_Workers)
+void InitAnts(Ant & myAnt, Params & Par)
+{
+    // allocate space for the thresholds
+    myAnt.threshold.resize(Par.tasks);
+
+    if (Par.maxgen <= 1)
     {
-        // or just assing thresholds from parameters
+        // just assing thresholds from parameters
         for (int task = 0; task < Par.tasks; ++task)
         {
             myAnt.threshold[task] = Par.meanT[task];
@@ -469,10 +560,21 @@ void InitAnts(Ant & myAnt, Params & Par, Colony & myCol)
 
 
 // Initilializes all colonies at the start of each evolutionary generation
-void Init(Population & Pop, Params & Par)
+void Init(Population & Pop, Params & Par, int generation)
 {
+# pragma omp parallel for num_threads(num_threads)
     for (unsigned int colony_i = 0; colony_i < Pop.size(); ++colony_i)
     {
+        // the random number streams of this colony in this generation.
+        // The one used every timestep is buffered, with room for about
+        // a timestep's worth of random numbers: a word per ant (quitting,
+        // switching, the order of the ants) and two gaussians per ant 
+        // and task (noise on stimulus and threshold, see WantTask)
+        philox_rng rng_workers;
+        philox_rng_set(rng_workers, Par.seed, RNG_WORKERS, generation, colony_i);
+        philox_buffer_set(Pop[colony_i].rng_ecology, Par.seed, RNG_ECOLOGY, 
+                generation, colony_i, Par.N, 2 * Par.N * Par.tasks);
+
         Pop[colony_i].MyAnts.resize(Par.N);
         Pop[colony_i].ID = colony_i;
         Pop[colony_i].fitness = 0;
@@ -517,9 +619,19 @@ void Init(Population & Pop, Params & Par)
             Pop[colony_i].mean_work_alloc.push_back(0);
         }
     
+        Pop[colony_i].order.resize(Par.N);
+
         for (unsigned int j = 0; j < Pop[colony_i].MyAnts.size(); ++j)
         {
-            InitAnts(Pop[colony_i].MyAnts[j], Par, Pop[colony_i]);
+            InitAnts(Pop[colony_i].MyAnts[j], Par);
+            Pop[colony_i].order[j] = j;
+        }
+
+        // inherit from mom and dad, then mutate
+        if (Par.maxgen > 1)
+        {
+            Inherit_Workers(Pop[colony_i], Par, rng_workers);
+            Mutate_Workers(Pop[colony_i], Par, rng_workers);
         }
     } // end of for colony_i
 } // end of Init()
@@ -586,7 +698,7 @@ void QuitTask(Colony & anyCol, Ant & anyAnt, int job, Params & Par)
 {
     assert(anyAnt.curr_act < Par.tasks);
     // ant quits
-    if (gsl_rng_uniform(rng_global) < Par.p)
+    if (philox_buffer_uniform(anyCol.rng_ecology) < Par.p)
     {
         // ant does not want to do current task
         anyAnt.want_task[anyAnt.curr_act] = false;
@@ -630,7 +742,7 @@ double RPfunction (double t, double s)
 
 // take account of which task an ant is currently engaged
 // in (and in absence of simultaneous updating)
-void DoTask(Params Par, Colony & anyCol, Ant & anyAnt,int job)
+void DoTask(Params & Par, Colony & anyCol, Ant & anyAnt,int job)
 {
     assert(job < Par.tasks);
     // updating her current act for the task she's doing
@@ -648,7 +760,7 @@ void DoTask(Params Par, Colony & anyCol, Ant & anyAnt,int job)
 //
 
 // check which stimuli (when noise added) exceed the thresholds
-void WantTask(Params Par, Colony & anyCol, Ant & anyAnt)
+void WantTask(Params & Par, Colony & anyCol, Ant & anyAnt)
 {
     // variable that stores which tasks
     // have stimulus levels that exceed the threshold
@@ -659,10 +771,10 @@ void WantTask(Params Par, Colony & anyCol, Ant & anyAnt)
 	{
         // add random noise to both threshold and stimulus
         double stim_noise = anyCol.stim[task_i] + 
-            gsl_ran_gaussian(rng_global,1.0);
+            philox_buffer_gaussian(anyCol.rng_ecology, 1.0);
 
         double t_noise =  anyAnt.threshold[task_i] + 
-            gsl_ran_gaussian(rng_global,1.0);
+            philox_buffer_gaussian(anyCol.rng_ecology, 1.0);
 
         if (stim_noise < 0)
         {
@@ -692,7 +804,7 @@ void WantTask(Params Par, Colony & anyCol, Ant & anyAnt)
     if (counter.size() > 1) 
 	{
         // select a random job
-		int job = gsl_rng_uniform_int(rng_global, counter.size());
+		int job = philox_buffer_uniform_int(anyCol.rng_ecology, counter.size());
 		anyAnt.want_task[counter[job]] = true;
 	}
     else if (!counter.empty())
@@ -722,7 +834,7 @@ void EvalTaskSwitch (Params & Par, Colony & anyCol, Ant & anyAnt, int myjob)
     {
         // find out whether ant cannot switch 
         // to a different ask but has to wait
-        if (Par.p_wait >= gsl_rng_uniform(rng_global)
+        if (Par.p_wait >= philox_buffer_uniform(anyCol.rng_ecology)
                 && anyAnt.count_time < Par.timecost)    
         {
             anyAnt.curr_act = Par.tasks; // stays idle for as long as count_time<timecost    
@@ -800,286 +912,251 @@ void TaskChoice(Params & Par, Colony & anyCol, Ant & anyAnt)
 } // end of TaskChoice()
 
 
-// update ants and number of switches
+// update ants and number of switches of a colony
 // runs once per ecological timestep
-void UpdateAnts(Population & Pop, Params & Par)
+void UpdateAnts(Colony & anyCol, Params & Par)
 {
     int current_act;
 
-    // loop through colonies
-    for (unsigned int colony_i = 0; colony_i < Pop.size(); ++colony_i)
+    anyCol.inactive = 0;
+
+    for (int task = 0; task < Par.tasks; ++task)
     {
-        Pop[colony_i].inactive = 0;
+        // reset statistics on work for tasks to 0
+        anyCol.workfor[task] = 0; 
+    }
+    // go through individual ants of the colony
+    //
+    // let active ants potentially quit
+    // let idle ants potentially find work
 
-        for (int task = 0; task < Par.tasks; ++task)
+    // first shuffle the order in which ants are visited 
+    // (Fisher-Yates). Only the indices are moved, the ants 
+    // themselves stay in place
+    vector <int> & order = anyCol.order;
+
+    for (int order_i = order.size() - 1; order_i > 0; --order_i)
+    {
+        int other_i = philox_buffer_uniform_int(anyCol.rng_ecology, order_i + 1);
+        swap(order[order_i], order[other_i]);
+    }
+ 
+    for (unsigned int order_i = 0; order_i < order.size(); ++order_i)  
+    {
+        Ant & myAnt = anyCol.MyAnts[order[order_i]];
+
+        // check whether ant is currently active
+        if (myAnt.curr_act < Par.tasks)
         {
-            // reset statistics on work for tasks to 0
-            Pop[colony_i].workfor[task] = 0; 
+            myAnt.last_act = myAnt.curr_act; //record last act
+
+            // check whether ant quits
+            QuitTask(anyCol, 
+                    myAnt, 
+                    myAnt.curr_act, 
+                    Par); 
         }
-        // go through individual ants of the colony
-        //
-        // let active ants potentially quit
-        // let idle ants potentially find work
 
-        // first shuffle vectors
-        random_shuffle(Pop[colony_i].MyAnts.begin(), Pop[colony_i].MyAnts.end());
-     
-        for (unsigned int ant_i = 0; 
-                ant_i < Pop[colony_i].MyAnts.size(); ++ant_i)  
+        // ant is currently inactive
+        if (myAnt.curr_act >= Par.tasks)
         {
-            // check whether ant is currently active
-            if (Pop[colony_i].MyAnts[ant_i].curr_act < Par.tasks)
-            {
-                Pop[colony_i].MyAnts[ant_i].last_act = 
-                    Pop[colony_i].MyAnts[ant_i].curr_act; //record last act
-
-                // check whether ant quits
-                QuitTask(Pop[colony_i], 
-                        Pop[colony_i].MyAnts[ant_i], 
-                        Pop[colony_i].MyAnts[ant_i].curr_act, 
-                        Par); 
-            }
-
-            // ant is currently inactive
-            if (Pop[colony_i].MyAnts[ant_i].curr_act >= Par.tasks)
-            {
-                //if inactive, choose a task 
-                TaskChoice(Par, Pop[colony_i], Pop[colony_i].MyAnts[ant_i]); 
-            }
+            //if inactive, choose a task 
+            TaskChoice(Par, anyCol, myAnt); 
+        }
 
-            //if ant (still nor just now) active 
-            // update counters
-            if (Pop[colony_i].MyAnts[ant_i].curr_act < Par.tasks)
-            {
-                current_act = Pop[colony_i].MyAnts[ant_i].curr_act;
-                // update the number of acts done
-                ++Pop[colony_i].numacts[current_act];
-                ++Pop[colony_i].MyAnts[ant_i].countacts[current_act];
-           
-                // update number of switches
-                if (Pop[colony_i].MyAnts[ant_i].last_act != 
-                        Pop[colony_i].MyAnts[ant_i].curr_act)
-                {
-                    Pop[colony_i].MyAnts[ant_i].switches++;
-                }
-            }
-            else
+        //if ant (still nor just now) active 
+        // update counters
+        if (myAnt.curr_act < Par.tasks)
+        {
+            current_act = myAnt.curr_act;
+            // update the number of acts done
+            ++anyCol.numacts[current_act];
+            ++myAnt.countacts[current_act];
+       
+            // update number of switches
+            if (myAnt.last_act != myAnt.curr_act)
             {
-                Pop[colony_i].inactive++;
+                myAnt.switches++;
             }
-        }// ant for ant_i 
-
-        // update proportion of inactive workers 
-        Pop[colony_i].inactive /= Pop[colony_i].MyAnts.size(); 
+        }
+        else
+        {
+            anyCol.inactive++;
+        }
+    }// ant for order_i 
 
-    } // end for colony_i
+    // update proportion of inactive workers 
+    anyCol.inactive /= anyCol.MyAnts.size(); 
 }  // end of UpdateAnts()
 //------------------------------------------------------------------------------
 
-//stochsine
-//Creates value for delta with a stochastic sine wave (Botero et al. 2015)
-void Stochsine(Params & Par)
-{
-    for (int task_i = 0; task_i < Par.tasks; ++task_i)
-    {
-        Par.delta[task_i] =  //plus one for baseline stimulus increase
-            Par.deltabaseline[task_i] + (Par.A  * sin((2 *
-
-            //pi
-            M_PI *
-
-            //Calculate cumulative timesteps
-            ((Par.maxtime * Par.gensdone) + Par.stepsdone)
-
-            ) / Par.maxtime* Par.genspercycle))
-            + (Par.B *
-
-            //Random number between -1 and 1
-            ((gsl_rng_uniform_pos(rng_global)*2)-1));
-    }
-}
-
-
-
-// Increases the stimulus by delta
+// Increases the stimulus by delta (the environment of this 
+// timestep, see Next_Environment)
 // Decreases the stimulus depending on the amount of work done towards a task
-void UpdateStim(Population & Pop, Params & Par)   
+void UpdateStim(Colony & anyCol, Params & Par, const double * delta)   
 {
-	//stochsine
-	Stochsine(Par);
-
-    // go through all colonies
-    for (unsigned int colony_i = 0; colony_i < Pop.size(); ++colony_i)
+    for (int task=0; task < Par.tasks; ++task)
     {
-
-        for (int task=0; task < Par.tasks; ++task)
-        {
-            // update the value of the stimulus as in 
-            // in eq. (3) of Bonabeau, with the difference that 
-            // s(t) is multiplied by decay parameter 1-beta
-            Pop[colony_i].newstim[task] = (1.0 - Par.beta[task]) * Pop[colony_i].stim[task] 
-                + Par.delta[task];
-            
-            
+        // update the value of the stimulus as in 
+        // in eq. (3) of Bonabeau, with the difference that 
+        // s(t) is multiplied by decay parameter 1-beta
+        anyCol.newstim[task] = (1.0 - Par.beta[task]) * anyCol.stim[task] 
+            + delta[task];
+        
+        
 #ifdef SIMULTANEOUS_UPDATE
-            // in case of simultaneous update subtract all the work done
-            // from the stimulus dynamic in one go
-            // otherwise this will be done per ant later on
-            Pop[colony_i].newstim[task] -= (Pop[colony_i].workfor[task]/Par.N); 
+        // in case of simultaneous update subtract all the work done
+        // from the stimulus dynamic in one go
+        // otherwise this will be done per ant later on
+        anyCol.newstim[task] -= (anyCol.workfor[task]/Par.N); 
 #endif
 
-            // update the stimulus
-            Pop[colony_i].stim[task] = Pop[colony_i].newstim[task];
-            
-            // stimulus cannot be negative
-            if (Pop[colony_i].stim[task] < 0)
-            {
-                Pop[colony_i].stim[task] = 0;
-            }
-
-        } // end for task
-    } // end for colony_i
+        // update the stimulus
+        anyCol.stim[task] = anyCol.newstim[task];
+        
+        // stimulus cannot be negative
+        if (anyCol.stim[task] < 0)
+        {
+            anyCol.stim[task] = 0;
+        }
 
+    } // end for task
 } // end UpdateStim()
 //------------------------------------------------------------------------------
 
-void Calc_F(Population & Pop, Params & Par) // calculate specialization 
+void Calc_F(Colony & anyCol, Params & Par) // calculate specialization 
 {
     double C;
 
-    for (unsigned int colony_i = 0;  colony_i < Pop.size(); ++colony_i)
-    {
-        Pop[colony_i].mean_F = 0; // F varies between -1 and 1
-        Pop[colony_i].mean_F_franjo = 0; // F_franjo varies between 0 and 1 
-        Pop[colony_i].mean_switches = 0; 
-        Pop[colony_i].mean_workperiods = 0; 
+    anyCol.mean_F = 0; // F varies between -1 and 1
+    anyCol.mean_F_franjo = 0; // F_franjo varies between 0 and 1 
+    anyCol.mean_switches = 0; 
+    anyCol.mean_workperiods = 0; 
 
-        double F_franjo;
-        double mean_F_franjo = 0;
+    double F_franjo;
+    double mean_F_franjo = 0;
 
-        double sumsquares_F = 0;
-        double sumsquares_F_franjo = 0;
+    double sumsquares_F = 0;
+    double sumsquares_F_franjo = 0;
 
-        double sumsquares_switches = 0;
-        double sumsquares_workperiods = 0;
+    double sumsquares_switches = 0;
+    double sumsquares_workperiods = 0;
 
-        // keep track of the total number of ants
-        // who have worked at least once
-        size_t n_ants_active = 0;
+    // keep track of the total number of ants
+    // who have worked at least once
+    size_t n_ants_active = 0;
 
-        for (unsigned int ant_i = 0; ant_i < Pop[colony_i].MyAnts.size(); ++ant_i)
-        {
-            assert(Pop[colony_i].MyAnts[ant_i].workperiods <= Par.maxtime);
-            C = 0;
+    for (unsigned int ant_i = 0; ant_i < anyCol.MyAnts.size(); ++ant_i)
+    {
+        assert(anyCol.MyAnts[ant_i].workperiods <= Par.maxtime);
+        C = 0;
 
-            // calculate average number of workperiods
-            Pop[colony_i].mean_workperiods += Pop[colony_i].MyAnts[ant_i].workperiods;
-            
-            // calculate sum of squares for variance
-            sumsquares_workperiods += Pop[colony_i].MyAnts[ant_i].workperiods * 
-                Pop[colony_i].MyAnts[ant_i].workperiods;
+        // calculate average number of workperiods
+        anyCol.mean_workperiods += anyCol.MyAnts[ant_i].workperiods;
+        
+        // calculate sum of squares for variance
+        sumsquares_workperiods += anyCol.MyAnts[ant_i].workperiods * 
+            anyCol.MyAnts[ant_i].workperiods;
 
-            // if this ant has ever worked take statistics on switches
-            if (Pop[colony_i].MyAnts[ant_i].workperiods > 1)
-            {
-                // calculate mean switches and 
-                // workperiods for book-keeping
-                Pop[colony_i].mean_switches += Pop[colony_i].MyAnts[ant_i].switches;
-
-                // calculate sum of squares for variance
-                sumsquares_switches += Pop[colony_i].MyAnts[ant_i].switches * 
-                    Pop[colony_i].MyAnts[ant_i].switches;
-      
-
-                //  C is frequency of switching between tasks 
-                //  which is the number of switches divided by the total number of
-                //  possible switches, which is the number of workperiods minus 1
-                //  (as one cannot switch anymore during the final workperiod)
-                C = (double) Pop[colony_i].MyAnts[ant_i].switches / 
-                    (Pop[colony_i].MyAnts[ant_i].workperiods - 1.0);
-
-
-                // F is between -1 and 1
-                Pop[colony_i].MyAnts[ant_i].F = 1.0 - 2.0 *C;
-                // F_franjo is between 0 and 1
-                //
-                F_franjo = 1.0 - C;
-                
-                // sum all values of F to calculate averages
-                Pop[colony_i].mean_F += Pop[colony_i].MyAnts[ant_i].F;
-                mean_F_franjo += F_franjo;
+        // if this ant has ever worked take statistics on switches
+        if (anyCol.MyAnts[ant_i].workperiods > 1)
+        {
+            // calculate mean switches and 
+            // workperiods for book-keeping
+            anyCol.mean_switches += anyCol.MyAnts[ant_i].switches;
 
-                sumsquares_F += Pop[colony_i].MyAnts[ant_i].F *
-                    Pop[colony_i].MyAnts[ant_i].F;
+            // calculate sum of squares for variance
+            sumsquares_switches += anyCol.MyAnts[ant_i].switches * 
+                anyCol.MyAnts[ant_i].switches;
+  
 
-                sumsquares_F_franjo += F_franjo * F_franjo;
+            //  C is frequency of switching between tasks 
+            //  which is the number of switches divided by the total number of
+            //  possible switches, which is the number of workperiods minus 1
+            //  (as one cannot switch anymore during the final workperiod)
+            C = (double) anyCol.MyAnts[ant_i].switches / 
+                (anyCol.MyAnts[ant_i].workperiods - 1.0);
 
-                // count this ant as an active one (as it has worked
-                // at least once)
-                ++n_ants_active;
-            } // end if workperiods > 0
-        } // end for ant_i
 
-        // if there have been active ants, calculate switch rate
-        // and specialization values
-        if (n_ants_active > 0)
-        {
-            // calculate average switch rate by 
-            // dividing by the number of active ants
-            Pop[colony_i].mean_switches /= n_ants_active;
+            // F is between -1 and 1
+            anyCol.MyAnts[ant_i].F = 1.0 - 2.0 *C;
+            // F_franjo is between 0 and 1
+            //
+            F_franjo = 1.0 - C;
             
-            // calculate variance in switch rate
-            Pop[colony_i].var_switches = sumsquares_switches / n_ants_active - 
-                Pop[colony_i].mean_switches * Pop[colony_i].mean_switches;
+            // sum all values of F to calculate averages
+            anyCol.mean_F += anyCol.MyAnts[ant_i].F;
+            mean_F_franjo += F_franjo;
 
-            Pop[colony_i].mean_F /= n_ants_active;
+            sumsquares_F += anyCol.MyAnts[ant_i].F *
+                anyCol.MyAnts[ant_i].F;
 
-            Pop[colony_i].mean_F_franjo /= n_ants_active;
+            sumsquares_F_franjo += F_franjo * F_franjo;
 
-            Pop[colony_i].var_F = sumsquares_F / n_ants_active - 
-                Pop[colony_i].mean_F * Pop[colony_i].mean_F;
+            // count this ant as an active one (as it has worked
+            // at least once)
+            ++n_ants_active;
+        } // end if workperiods > 0
+    } // end for ant_i
 
-            Pop[colony_i].var_F_franjo = sumsquares_F_franjo / n_ants_active - 
-                Pop[colony_i].mean_F_franjo * Pop[colony_i].mean_F_franjo;
-        }
-        else // no active ants whatsoever, set switch rate stats to 0
-        {
-            Pop[colony_i].mean_switches = 0.0;
-            Pop[colony_i].var_switches = 0.0;
-            Pop[colony_i].mean_F = 0.0;
-            Pop[colony_i].mean_F_franjo = 0.0;
-            Pop[colony_i].var_F = 0.0;
-            Pop[colony_i].var_F_franjo = 0.0;
-        }
-    
-        if (abs(std::isnan(Pop[colony_i].mean_F)) > 0)
-        {
-            cout << colony_i << endl;
-        }
-        else if(abs(std::isinf(Pop[colony_i].mean_switches)) == 1)
-        {
-            cout << colony_i << endl;
-        }
+    // if there have been active ants, calculate switch rate
+    // and specialization values
+    if (n_ants_active > 0)
+    {
+        // calculate average switch rate by 
+        // dividing by the number of active ants
+        anyCol.mean_switches /= n_ants_active;
         
+        // calculate variance in switch rate
+        anyCol.var_switches = sumsquares_switches / n_ants_active - 
+            anyCol.mean_switches * anyCol.mean_switches;
+
+        anyCol.mean_F /= n_ants_active;
+
+        anyCol.mean_F_franjo /= n_ants_active;
 
+        anyCol.var_F = sumsquares_F / n_ants_active - 
+            anyCol.mean_F * anyCol.mean_F;
 
-        assert(std::isnan(Pop[colony_i].mean_F) == 0);
-        assert(std::isnan(Pop[colony_i].mean_switches) == 0);
-        assert(abs(std::isinf(Pop[colony_i].mean_F)) < 1);
-        assert(abs(std::isinf(Pop[colony_i].mean_switches)) < 1);
+        anyCol.var_F_franjo = sumsquares_F_franjo / n_ants_active - 
+            anyCol.mean_F_franjo * anyCol.mean_F_franjo;
+    }
+    else // no active ants whatsoever, set switch rate stats to 0
+    {
+        anyCol.mean_switches = 0.0;
+        anyCol.var_switches = 0.0;
+        anyCol.mean_F = 0.0;
+        anyCol.mean_F_franjo = 0.0;
+        anyCol.var_F = 0.0;
+        anyCol.var_F_franjo = 0.0;
+    }
 
+    if (abs(std::isnan(anyCol.mean_F)) > 0)
+    {
+        cout << anyCol.ID << endl;
+    }
+    else if(abs(std::isinf(anyCol.mean_switches)) == 1)
+    {
+        cout << anyCol.ID << endl;
+    }
+    
 
-        // calculate mean workperiods by dividing by the total number of ants
-        Pop[colony_i].mean_workperiods /= Pop[colony_i].MyAnts.size();
 
-        // calculate variance in workperiods
-        Pop[colony_i].var_workperiods = 
-            sumsquares_workperiods / Pop[colony_i].MyAnts.size() -
-                Pop[colony_i].mean_workperiods * Pop[colony_i].mean_workperiods;
+    assert(std::isnan(anyCol.mean_F) == 0);
+    assert(std::isnan(anyCol.mean_switches) == 0);
+    assert(abs(std::isinf(anyCol.mean_F)) < 1);
+    assert(abs(std::isinf(anyCol.mean_switches)) < 1);
 
-        // calculate average switch rate by dividing by the number of active ants
-    } // end for Colonies
 
+    // calculate mean workperiods by dividing by the total number of ants
+    anyCol.mean_workperiods /= anyCol.MyAnts.size();
+
+    // calculate variance in workperiods
+    anyCol.var_workperiods = 
+        sumsquares_workperiods / anyCol.MyAnts.size() -
+            anyCol.mean_workperiods * anyCol.mean_workperiods;
+
+    // calculate average switch rate by dividing by the number of active ants
 } // end of Calc_F()
 //==============================================================================================================================================
 
@@ -1091,15 +1168,14 @@ void CalcFitness(Population & Pop, Params & Par)
 {
     sum_Fit = 0;
 
-    double total;
-
-    bool ant_is_idle;
-
+    // fitness of each colony on its own
+# pragma omp parallel for num_threads(num_threads)
     for (unsigned int colony_i = 0; colony_i < Pop.size(); ++colony_i)
     {
         Pop[colony_i].idle = 0;
 
-        total = 0;
+        double total = 0;
+        bool ant_is_idle;
 
         // calculate total work periods
         for (int task_i = 0; task_i < Par.tasks; ++task_i)
@@ -1184,9 +1260,9 @@ void CalcFitness(Population & Pop, Params & Par)
 
 // Draw a parent from the cumulative distribution
 // Randomly selects genotype samples from all colonies based on their fitness (fittest more likely to be chosen)
-int drawParent(int nCol, Population & Pop)
+int drawParent(int nCol, Population & Pop, philox_rng & rng_r)
 {
-    const double draw = gsl_rng_uniform(rng_global); 
+    const double draw = philox_rng_uniform(rng_r); 
     int cmin=-1, cmax=nCol-1;
 
     // binary search of cumulative fitness value
@@ -1209,13 +1285,20 @@ int drawParent(int nCol, Population & Pop)
 
 //Creates the sexual individuals from a colony.
 //Repeats drawParent until all required samples are collected.
-void MakeSexuals(Population & Pop, Params & Par)
+//
+// every sexual has its own random number stream, so that sexuals
+// are made in parallel
+void MakeSexuals(Population & Pop, Params & Par, int generation)
 {
     mySexuals.resize(2 * Par.Col); // number of sexuals needed
     parentCol.resize(mySexuals.size());
 
+# pragma omp parallel for num_threads(num_threads)
     for (unsigned int ind = 0; ind < mySexuals.size(); ++ind)
 	{
+        philox_rng rng_r;
+        philox_rng_set(rng_r, Par.seed, RNG_SEXUALS, generation, ind);
+
         //initialize sexuals
         mySexuals[ind].threshold.resize(Par.tasks);
         mySexuals[ind].countacts.clear();
@@ -1229,12 +1312,13 @@ void MakeSexuals(Population & Pop, Params & Par)
         
         
         // draw a parent colony for each sexual
-        parentCol[ind] = drawParent(Pop.size(), Pop);
+        parentCol[ind] = drawParent(Pop.size(), Pop, rng_r);
 
         Inherit(mySexuals[ind], 
                 Pop[parentCol[ind]].queen, 
                 Pop[parentCol[ind]].male, 
-                Par);
+                Par,
+                rng_r);
 
 	}// end for ind
 }
@@ -1249,12 +1333,16 @@ void MakeColonies(Population &Pop, Params &Par, int generation)
     // to, if simulation may be continued at a later time
     static ofstream lastgen;
 
+    // the random number stream used to pair sexuals into colonies
+    philox_rng rng_r;
+    philox_rng_set(rng_r, Par.seed, RNG_REPRODUCTION, generation, 0);
+
     for (unsigned int col = 0; col < Pop.size(); ++col)
 	{
         do
         {
-            mother = gsl_rng_uniform_int(rng_global, mySexuals.size());
-            father = gsl_rng_uniform_int(rng_global, mySexuals.size());
+            mother = philox_rng_uniform_int(rng_r, mySexuals.size());
+            father = philox_rng_uniform_int(rng_r, mySexuals.size());
         }
         while
 		(mother == father 
@@ -1344,23 +1432,165 @@ void Start_Simulation_From_Previous(Params & Par, Population & Pop)
 
 void Update_Col_Data(
         int step,  // current timestep
-        Population & Pop, 
+        Colony & anyCol, 
         Params & Par)
 {
 	if (step >= Par.tau) 
+    {
+        for (int task = 0; task < Par.tasks; ++task)
+        {
+            anyCol.last_half_acts[task] += 
+                anyCol.workfor[task]/Par.alfa[task];
+            
+            anyCol.mean_work_alloc[task] += 
+                anyCol.workfor[task] / Par.alfa[task];
+        }	
+    }
+}
+
+// the environment (delta of every task at every timestep, see 
+// environment.h) of the current generation, shared by all colonies:
+// either generated, or read from the replay file (-r). When a save 
+// file is given (-w), it is also written there
+void Next_Environment(Params & Par, 
+        environment & env,
+        ifstream & replay, 
+        ofstream & save)
+{
+    if (replay.is_open())
+    {
+        if (!environment_read(replay, env, Par.tasks, Par.maxtime, Par.gensdone))
+        {
+            cout << "error: " << environment_replay_file 
+                << " has no environment for generation " << Par.gensdone 
+                << " with " << Par.tasks << " tasks and " 
+                << Par.maxtime << " timesteps" << endl;
+            exit(1);
+        }
+    }
+    else
+    {
+        environment_generate(env, 
+                Par.deltabaseline, 
+                Par.A, 
+                Par.B, 
+                Par.maxtime, 
+                Par.genspercycle, 
+                Par.seed, 
+                Par.gensdone);
+    }
+
+    if (save.is_open())
+    {
+        environment_write(save, env);
+    }
+}
+
+// number of values recorded per timestep for data_1gen.txt:
+// the stimuli and the workers per task, fitness, mean F 
+// and scaled mean F_franjo
+int Step_Record_Size(Params & Par)
+{
+    return 2 * Par.tasks + 3;
+}
+
+// record the values of a colony at the current timestep
+void Record_Step(Colony & anyCol, Params & Par, double * record)
+{
+    double p1 = (double) anyCol.numacts[0] / 
+        (anyCol.numacts[0] + anyCol.numacts[1]);
+
+    double p2 = (double) anyCol.numacts[1] / 
+        (anyCol.numacts[0] + anyCol.numacts[1]);
+
+    double denomin = p1*p1 + p2*p2;
+
+    for (int task = 0; task < Par.tasks; ++task)
+    {
+        *record++ = anyCol.stim[task];
+    }
+
+    for (int task = 0; task < Par.tasks; ++task)
+    {
+        *record++ = anyCol.workfor[task] / Par.alfa[task];
+    }
+
+    *record++ = anyCol.fitness;
+    *record++ = anyCol.mean_F;
+    *record++ = anyCol.mean_F_franjo / denomin;
+}
+
+// simulate a colony for all timesteps of a generation. When records
+// is given, the values of every timestep are recorded there
+//
+// the specialization values (see Calc_F) only depend on the switches
+// and workperiods counted so far, and are only read once the colony 
+// has gone through the generation, so they are calculated once at the
+// end, or at every timestep only when they are recorded
+void Simulate_Colony(Colony & anyCol, 
+        Params & Par, 
+        const environment & env,
+        double * records)
+{
+    for (int k = 0; k < Par.maxtime; k++)
+    {
+        // update all the ants in the colony
+        UpdateAnts(anyCol, Par);
+
+        // update all stimulus levels of the colony
+        UpdateStim(anyCol, Par, environment_step(env, k));
+
+        // update all the fitness data etc
+        Update_Col_Data(k, anyCol, Par);
+
+        if (records != NULL)
+        {
+            // calculate specialization values
+            Calc_F(anyCol, Par); 
+
+            Record_Step(anyCol, Par, &records[k * Step_Record_Size(Par)]);
+        }
+    }
+
+    if (records == NULL)
+    {
+        Calc_F(anyCol, Par);
+    }
+}
+
+// write the recorded values of all colonies in the last generation 
+// timestep by timestep. Fitness is only known after the last 
+// timestep (see CalcFitness), before that it is written as 0
+void Write_Steps(ofstream & data_1gen, 
+        Params & Par, 
+        Population & Pop,
+        vector <double> & records)
+{
+    int record_size = Step_Record_Size(Par);
+
+    for (int k = 0; k < Par.maxtime; ++k)
     {
         for (unsigned int col = 0; col < Pop.size(); ++col)
         {
-            for (int task = 0; task < Par.tasks; ++task)
+            double * record = &records[(col * Par.maxtime + k) * record_size];
+
+            data_1gen << k << ";" << col << ";"; 
+
+            for (int value_i = 0; value_i < 2 * Par.tasks; ++value_i)
             {
-                Pop[col].last_half_acts[task] += 
-                    Pop[col].workfor[task]/Par.alfa[task];
-                
-                Pop[col].mean_work_alloc[task] += 
-                    Pop[col].workfor[task] / Par.alfa[task];
-            }	
+                data_1gen << record[value_i] << ";"; 
+            }
+
+            double fitness = k == Par.maxtime - 1 ? 
+                Pop[col].fitness : record[2 * Par.tasks];
+
+            data_1gen << fitness << ";" << 
+                    record[2 * Par.tasks + 1] << ";" << 
+                    record[2 * Par.tasks + 2] << "\n"; 
         }
     }
+
+    data_1gen.flush();
 }
 
 void Write_Headers(
@@ -1590,23 +1820,59 @@ void StopIfSpec(
 
 } // end StopIfSpec
 
+//=====================================================================================================
+// read the run options from the command line:
+// -t <threads>             number of threads (default: all cores)
+// -w <environment_file>    write the environment of every generation
+//                          to this file (see environment_write)
+// -r <environment_file>    replay the environment of every generation
+//                          from a file written with -w, instead of
+//                          generating it (see Next_Environment)
+void Init_Run_Options(int argc, char* argv[])
+{
+    num_threads = omp_get_num_procs();
+
+    for (int arg_i = 1; arg_i < argc; ++arg_i)
+    {
+        string arg = argv[arg_i];
+
+        if (arg == "-t" && arg_i + 1 < argc)
+        {
+            num_threads = atoi(argv[++arg_i]);
+        }
+        else if (arg == "-w" && arg_i + 1 < argc)
+        {
+            environment_save_file = argv[++arg_i];
+        }
+        else if (arg == "-r" && arg_i + 1 < argc)
+        {
+            environment_replay_file = argv[++arg_i];
+        }
+        else
+        {
+            cout << "usage: " << argv[0] 
+                << " [-t threads] [-w environment_file] [-r environment_file]" << endl;
+            exit(1);
+        }
+    }
+
+    if (num_threads < 1)
+    {
+        cout << "error: number of threads should be positive" << endl;
+        exit(1);
+    }
+}
+
 int main(int argc, char* argv[])
 {
+    // number of threads
+    Init_Run_Options(argc, argv);
+
 	Params myPars;
 
 	ifstream inp("params.txt");
 	myPars.InitParams(inp);
 	ShowParams(myPars);
-	
-    // set up the random number generators
-    // (from the gnu gsl library)
-    gsl_rng_env_setup();
-    T = gsl_rng_default;
-    rng_global = gsl_rng_alloc(T);
-    gsl_rng_set(rng_global, myPars.seed);
-
-    // also set the seed to be used by random_shuffle
-    srand(myPars.seed);
 
     // initialize the metapopulation
 	Population MyColonies;
@@ -1654,121 +1920,128 @@ int main(int argc, char* argv[])
 	    
 	out_ants.open(dataants.c_str()); 
 
+    // delta of every task at every timestep of the current generation
+    environment env;
+
+    ifstream environment_replay;
+    ofstream environment_save;
+
+    if (environment_replay_file != "")
+    {
+        environment_replay.open(environment_replay_file.c_str());
+
+        if (!environment_replay)
+        {
+            cout << "error: cannot open " << environment_replay_file << endl;
+            exit(1);
+        }
+    }
+
+    if (environment_save_file != "")
+    {
+        environment_save.open(environment_save_file.c_str());
+
+        if (!environment_save)
+        {
+            cout << "error: cannot open " << environment_save_file << endl;
+            exit(1);
+        }
+    }
+
+    // values for data_1gen.txt of every colony at every 
+    // timestep of the last generation, see Record_Step
+    // (only allocated in the last generation)
+    int record_size = Step_Record_Size(myPars);
+    vector <double> step_records;
+
     // evolutionary time
 	for (int g = simstart_generation; 
             g < simstart_generation + myPars.maxgen; ++g)
     {
         // initialize all colonies in this generation
-        Init(MyColonies, myPars);
+        Init(MyColonies, myPars, g);
         
-        double equil_steps=0;
-
 	    myPars.gensdone = g;
 
-        // Updates ant behaviour for each timestep (ecological timescale)
-        for (int k = 0; k < myPars.maxtime; k++)
-        {
-            // update all the ants in each colony
-            UpdateAnts(MyColonies, myPars);
-			myPars.stepsdone = k;
+        // the environment of every timestep of this generation
+        Next_Environment(myPars, env, environment_replay, environment_save);
 
-            // update all stimulus levels of each colony
-            UpdateStim(MyColonies, myPars);
+        bool last_generation = g == simstart_generation + myPars.maxgen - 1;
 
-            // calculate specialization values
-            Calc_F(MyColonies, myPars); 
+        if (last_generation)
+        {
+            step_records.resize(MyColonies.size() * myPars.maxtime * record_size);
+        }
 
-            // update all the fitness data etc
-            Update_Col_Data(k, MyColonies, myPars);
+        // run each colony through all timesteps (ecological timescale)
+        // while its workers are in cache; in the last generation, 
+        // each colony keeps the values of every timestep for 
+        // data_1gen.txt
+# pragma omp parallel for num_threads(num_threads) schedule(dynamic)
+        for (unsigned int col = 0; col < MyColonies.size(); ++col)
+        {
+            Simulate_Colony(MyColonies[col], 
+                    myPars, 
+                    env,
+                    last_generation ? &step_records[col * myPars.maxtime * record_size] : NULL);
+        }
 
-            if (k >= myPars.tau)
-            {
-                ++equil_steps;
-            }
+        // number of timesteps counting for fitness
+        double equil_steps = max(myPars.maxtime - max(myPars.tau, 0), 0);
            
-            // last timestep before reproduction
-            if (k == myPars.maxtime-1)
-            {
-                // calculate fitness of the colonies
-                CalcFitness(MyColonies, myPars);
+        // calculate fitness of the colonies
+        CalcFitness(MyColonies, myPars);
 
-                // output the data (only at the start or every 100th
-                // generation
-                if ((g <= 100 || g % 100==0))
+        // output the data (only at the start or every 100th
+        // generation
+        if ((g <= 100 || g % 100==0))
+        {
+            for (unsigned int col = 0; 
+                    col < MyColonies.size(); ++col)
+            {
+                for (int task=0; task<myPars.tasks; ++task)
                 {
-                    for (unsigned int col = 0; 
-                            col < MyColonies.size(); ++col)
-                    {
-                        for (int task=0; task<myPars.tasks; ++task)
-                        {
-                            MyColonies[col].mean_work_alloc[task] /= 
-                                equil_steps;
-                        }
-                           
-                        Write_Col_Data(out, myPars, MyColonies, g, col);
-                          
-                         // output only thresholds of foundresses and mean specialization 
-                        Write_Thresholds_Spec(threshold_dist_output_file, 
-                                specialization_dist_output_file, 
-                                myPars, 
-                                MyColonies, 
-                                g, 
-                                col);
-                         
-                    } // end of for colonies
-                } // end if generations are right
-            } // end if k=maxtime
-
-            // last generation, run output stuff
-            if (g == simstart_generation + myPars.maxgen - 1) 
+                    MyColonies[col].mean_work_alloc[task] /= 
+                        equil_steps;
+                }
+                   
+                Write_Col_Data(out, myPars, MyColonies, g, col);
+                  
+                 // output only thresholds of foundresses and mean specialization 
+                Write_Thresholds_Spec(threshold_dist_output_file, 
+                        specialization_dist_output_file, 
+                        myPars, 
+                        MyColonies, 
+                        g, 
+                        col);
+                 
+            } // end of for colonies
+        } // end if generations are right
+
+        // last generation, run output stuff
+        if (last_generation) 
+        {
+            Write_Steps(one_generation_output_file, 
+                    myPars, 
+                    MyColonies, 
+                    step_records);
+
+            for (unsigned int col = 0; col < MyColonies.size(); ++col)
             {
-                for (unsigned int col = 0; col < MyColonies.size(); ++col)
+                for (unsigned int ant=0; 
+                        ant < MyColonies[col].MyAnts.size(); ++ant)
                 {
-                    double p1 = (double) MyColonies[col].numacts[0] / 
-                        (MyColonies[col].numacts[0] + 
-                         MyColonies[col].numacts[1]);
-            
-                    double p2 = (double)MyColonies[col].numacts[1] / 
-                        (MyColonies[col].numacts[0] + 
-                         MyColonies[col].numacts[1]);
-            
-                    double denomin = p1*p1 + p2*p2;
-
-                    one_generation_output_file << k << ";" << col << ";"; 
-
-                    for (int task=0; task<myPars.tasks; task++)
-                    {
-                         one_generation_output_file <<MyColonies[col].stim[task] << ";"; 
-                    }
-
-                    for (int task=0; task<myPars.tasks; ++task)
-                    {
-                         one_generation_output_file << MyColonies[col].workfor[task]/
-                             myPars.alfa[task] << ";";
-                    }
-
-                    one_generation_output_file << MyColonies[col].fitness << ";" << 
-                            MyColonies[col].mean_F << ";" << 
-                            MyColonies[col].mean_F_franjo/denomin << endl; 
-
-                    if (k == myPars.maxtime -1)
-                    {	
-                        for (unsigned int ant=0; 
-                                ant < MyColonies[col].MyAnts.size(); ++ant)
-                        {
-                            out_ants << col << ";" 
-                                << ant << ";" 
-                                << MyColonies[col].MyAnts[ant].countacts[0] << ";" 
-                                << MyColonies[col].MyAnts[ant].countacts[1] << ";"
-                                << MyColonies[col].MyAnts[ant].switches << ";"
-                                << MyColonies[col].MyAnts[ant].workperiods << endl;  
-                        }
-                    }
-                }// endfor (unsigned int col
-            } // end if if (g == simstart_generation + myPars.maxgen - 1)   
-        } // end for (int k = 0; k < myPars.maxtime
-
-        MakeSexuals(MyColonies, myPars);
+                    out_ants << col << ";" 
+                        << ant << ";" 
+                        << MyColonies[col].MyAnts[ant].countacts[0] << ";" 
+                        << MyColonies[col].MyAnts[ant].countacts[1] << ";"
+                        << MyColonies[col].MyAnts[ant].switches << ";"
+                        << MyColonies[col].MyAnts[ant].workperiods << endl;  
+                }
+            }
+        } // end if last generation
+
+        MakeSexuals(MyColonies, myPars, g);
         MakeColonies(MyColonies, myPars, g);
 
     } // end for (int g = simstart_generation;
@@ -0,0 +1,424 @@
+#ifndef PHILOX_H_
+#define PHILOX_H_
+
+// counter-based random number streams, using the Philox4x32-10
+// generator of Salmon et al. (2011) Parallel random numbers: as easy
+// as 1, 2, 3. Proc. Int. Conf. High Performance Computing (SC'11)
+//
+// each stream is a pure function of its key (seed, purpose) and of
+// its position (generation, unit), where unit is typically a colony.
+// Hence streams do not depend on which thread uses them or in which
+// order, and setting up a stream does not allocate anything.
+//
+// the interface mimics that of the gsl_rng functions. Many random
+// words can also be generated at once (philox_fill), for which blocks
+// are encrypted four (AVX2) or eight (AVX-512) at a time, whichever the
+// cpu supports, unless SCALAR_KERNELS is defined
+
+#include <stdint.h>
+#include <stddef.h>
+#include <climits>
+#include <cmath>
+
+#if defined(__x86_64__) && !defined(SCALAR_KERNELS)
+#define PHILOX_X86
+#include <immintrin.h>
+#endif
+
+struct philox_rng
+{
+    uint32_t key[2]; // seed, purpose
+    uint32_t ctr[4]; // block number (2 words), unit, generation
+    uint32_t block[4]; // output of the current block
+    int used; // number of words of the current block already handed out
+
+    // Box-Muller produces gaussians in pairs, store the spare one
+    bool has_spare;
+    double spare;
+};
+
+// one Philox4x32 round
+inline void philox_round(uint32_t ctr[4], const uint32_t key[2])
+{
+    uint64_t prod0 = (uint64_t) 0xD2511F53 * ctr[0];
+    uint64_t prod1 = (uint64_t) 0xCD9E8D57 * ctr[2];
+
+    uint32_t hi0 = prod0 >> 32;
+    uint32_t lo0 = (uint32_t) prod0;
+    uint32_t hi1 = prod1 >> 32;
+    uint32_t lo1 = (uint32_t) prod1;
+
+    ctr[0] = hi1 ^ ctr[1] ^ key[0];
+    ctr[1] = lo1;
+    ctr[2] = hi0 ^ ctr[3] ^ key[1];
+    ctr[3] = lo0;
+}
+
+// encrypt the counter in ctr with key and write the result to out
+inline void philox4x32_10(const uint32_t ctr_in[4], const uint32_t key_in[2], uint32_t out[4])
+{
+    uint32_t key[2] = { key_in[0], key_in[1] };
+
+    for (int i = 0; i < 4; ++i)
+    {
+        out[i] = ctr_in[i];
+    }
+
+    for (int round = 0; round < 10; ++round)
+    {
+        if (round > 0)
+        {
+            // bump the key with the Weyl sequence constants
+            key[0] += 0x9E3779B9;
+            key[1] += 0xBB67AE85;
+        }
+
+        philox_round(out, key);
+    }
+}
+
+// position a stream at the start of the sequence
+// belonging to (seed, purpose, generation, unit)
+inline void philox_rng_set(philox_rng & r,
+        uint32_t seed,
+        uint32_t purpose,
+        uint32_t generation,
+        uint32_t unit)
+{
+    r.key[0] = seed;
+    r.key[1] = purpose;
+    r.ctr[0] = 0;
+    r.ctr[1] = 0;
+    r.ctr[2] = unit;
+    r.ctr[3] = generation;
+    r.used = 4;
+    r.has_spare = false;
+    r.spare = 0;
+}
+
+// restart a stream at the start of one of its substreams: the
+// substream is the high word of the block counter, so that 
+// substreams are independent as long as none of them uses more 
+// than 2^32 blocks
+inline void philox_rng_set_substream(philox_rng & r, uint32_t substream)
+{
+    r.ctr[0] = 0;
+    r.ctr[1] = substream;
+    r.used = 4;
+    r.has_spare = false;
+    r.spare = 0;
+}
+
+// next 32 random bits
+inline uint32_t philox_rng_get(philox_rng & r)
+{
+    if (r.used == 4)
+    {
+        philox4x32_10(r.ctr, r.key, r.block);
+
+        // advance the 64 bit block counter
+        if (++r.ctr[0] == 0)
+        {
+            ++r.ctr[1];
+        }
+
+        r.used = 0;
+    }
+
+    return r.block[r.used++];
+}
+
+// uniform number in [0,1)
+inline double philox_rng_uniform(philox_rng & r)
+{
+    return philox_rng_get(r) / 4294967296.0;
+}
+
+// uniform number in (0,1)
+inline double philox_rng_uniform_pos(philox_rng & r)
+{
+    return (philox_rng_get(r) + 0.5) / 4294967296.0;
+}
+
+// uniform integer in [0,n), without modulo bias
+// (Lemire 2019 ACM Trans Model Comput Simul 29: 3)
+inline unsigned long philox_rng_uniform_int(philox_rng & r, unsigned long n)
+{
+    uint64_t m = (uint64_t) philox_rng_get(r) * n;
+    uint32_t low = (uint32_t) m;
+
+    if (low < n)
+    {
+        uint32_t threshold = (uint32_t) -n % (uint32_t) n;
+
+        while (low < threshold)
+        {
+            m = (uint64_t) philox_rng_get(r) * n;
+            low = (uint32_t) m;
+        }
+    }
+
+    return m >> 32;
+}
+
+// gaussian deviate with standard deviation sigma (Box-Muller)
+inline double philox_ran_gaussian(philox_rng & r, double sigma)
+{
+    if (r.has_spare)
+    {
+        r.has_spare = false;
+        return sigma * r.spare;
+    }
+
+    double u1 = philox_rng_uniform_pos(r);
+    double u2 = philox_rng_uniform(r);
+
+    double radius = sqrt(-2.0 * log(u1));
+    double angle = 2.0 * M_PI * u2;
+
+    r.spare = radius * sin(angle);
+    r.has_spare = true;
+
+    return sigma * radius * cos(angle);
+}
+
+// number of failures before the first success in Bernoulli trials 
+// with probability p (geometrically distributed), from a uniform 
+// random number u in (0,1): used to go straight to the next of many
+// rare events (mutations, quitting) rather than drawing a random
+// number for each trial
+inline long geometric_skip(double p, double u)
+{
+    if (p >= 1)
+    {
+        return 0;
+    }
+
+    if (p <= 0)
+    {
+        return LONG_MAX;
+    }
+
+    double skip = floor(log(u) / log1p(-p));
+
+    return skip < LONG_MAX ? long(skip) : LONG_MAX;
+}
+
+// encrypt the blocks first_block, ..., first_block + n_blocks - 1
+// of a stream, writing 4 words per block to out
+typedef void (*philox_blocks_kernel)(const uint32_t key[2],
+        uint64_t first_block,
+        uint32_t unit,
+        uint32_t generation,
+        size_t n_blocks,
+        uint32_t * out);
+
+inline void philox_blocks_scalar(const uint32_t key[2],
+        uint64_t first_block,
+        uint32_t unit,
+        uint32_t generation,
+        size_t n_blocks,
+        uint32_t * out)
+{
+    for (size_t block_i = 0; block_i < n_blocks; ++block_i)
+    {
+        uint64_t block = first_block + block_i;
+        uint32_t ctr[4] = { (uint32_t) block, (uint32_t) (block >> 32), unit, generation };
+
+        philox4x32_10(ctr, key, out + 4 * block_i);
+    }
+}
+
+#ifdef PHILOX_X86
+
+// the SIMD versions keep each of the four counter words of several
+// blocks in the lower halves of 64 bit lanes, which is what the 
+// 32 x 32 -> 64 bit multiplications need. As in worker_kernels.h,
+// the AVX-512 version uses the masked forms of the intrinsics 
+// that would otherwise pass an undefined source operand
+
+__attribute__((target("avx2")))
+inline void philox_blocks_avx2(const uint32_t key[2],
+        uint64_t first_block,
+        uint32_t unit,
+        uint32_t generation,
+        size_t n_blocks,
+        uint32_t * out)
+{
+    const __m256i low_word = _mm256_set1_epi64x(0xFFFFFFFF);
+    const __m256i mult0 = _mm256_set1_epi64x(0xD2511F53);
+    const __m256i mult1 = _mm256_set1_epi64x(0xCD9E8D57);
+
+    size_t block_i = 0;
+
+    for (; block_i + 4 <= n_blocks; block_i += 4)
+    {
+        __m256i block = _mm256_add_epi64(_mm256_set1_epi64x(first_block + block_i),
+                _mm256_set_epi64x(3, 2, 1, 0));
+
+        __m256i ctr0 = _mm256_and_si256(block, low_word);
+        __m256i ctr1 = _mm256_srli_epi64(block, 32);
+        __m256i ctr2 = _mm256_set1_epi64x(unit);
+        __m256i ctr3 = _mm256_set1_epi64x(generation);
+
+        uint32_t key0 = key[0];
+        uint32_t key1 = key[1];
+
+        for (int round = 0; round < 10; ++round)
+        {
+            if (round > 0)
+            {
+                key0 += 0x9E3779B9;
+                key1 += 0xBB67AE85;
+            }
+
+            __m256i prod0 = _mm256_mul_epu32(ctr0, mult0);
+            __m256i prod1 = _mm256_mul_epu32(ctr2, mult1);
+
+            ctr0 = _mm256_xor_si256(_mm256_xor_si256(_mm256_srli_epi64(prod1, 32), ctr1),
+                    _mm256_set1_epi64x(key0));
+            ctr1 = _mm256_and_si256(prod1, low_word);
+            ctr2 = _mm256_xor_si256(_mm256_xor_si256(_mm256_srli_epi64(prod0, 32), ctr3),
+                    _mm256_set1_epi64x(key1));
+            ctr3 = _mm256_and_si256(prod0, low_word);
+        }
+
+        // words 0,1 and 2,3 of each block as 64 bit lanes,
+        // then interleaved into blocks 0,1 and 2,3
+        __m256i words01 = _mm256_or_si256(ctr0, _mm256_slli_epi64(ctr1, 32));
+        __m256i words23 = _mm256_or_si256(ctr2, _mm256_slli_epi64(ctr3, 32));
+        __m256i even = _mm256_unpacklo_epi64(words01, words23);
+        __m256i odd = _mm256_unpackhi_epi64(words01, words23);
+
+        _mm256_storeu_si256((__m256i *) (out + 4 * block_i),
+                _mm256_permute2x128_si256(even, odd, 0x20));
+        _mm256_storeu_si256((__m256i *) (out + 4 * block_i + 8),
+                _mm256_permute2x128_si256(even, odd, 0x31));
+    }
+
+    philox_blocks_scalar(key, first_block + block_i, unit, generation,
+            n_blocks - block_i, out + 4 * block_i);
+}
+
+__attribute__((target("avx512f")))
+inline void philox_blocks_avx512(const uint32_t key[2],
+        uint64_t first_block,
+        uint32_t unit,
+        uint32_t generation,
+        size_t n_blocks,
+        uint32_t * out)
+{
+    const __m512i low_word = _mm512_set1_epi64(0xFFFFFFFF);
+    const __mmask8 all_lanes = 0xFF;
+    const __m512i mult0 = _mm512_set1_epi64(0xD2511F53);
+    const __m512i mult1 = _mm512_set1_epi64(0xCD9E8D57);
+    const __m512i blocks_0_3 = _mm512_set_epi64(11, 3, 10, 2, 9, 1, 8, 0);
+    const __m512i blocks_4_7 = _mm512_set_epi64(15, 7, 14, 6, 13, 5, 12, 4);
+
+    size_t block_i = 0;
+
+    for (; block_i + 8 <= n_blocks; block_i += 8)
+    {
+        __m512i block = _mm512_add_epi64(_mm512_set1_epi64(first_block + block_i),
+                _mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0));
+
+        __m512i ctr0 = _mm512_and_si512(block, low_word);
+        __m512i ctr1 = _mm512_maskz_srli_epi64(all_lanes, block, 32);
+        __m512i ctr2 = _mm512_set1_epi64(unit);
+        __m512i ctr3 = _mm512_set1_epi64(generation);
+
+        uint32_t key0 = key[0];
+        uint32_t key1 = key[1];
+
+        for (int round = 0; round < 10; ++round)
+        {
+            if (round > 0)
+            {
+                key0 += 0x9E3779B9;
+                key1 += 0xBB67AE85;
+            }
+
+            __m512i prod0 = _mm512_maskz_mul_epu32(all_lanes, ctr0, mult0);
+            __m512i prod1 = _mm512_maskz_mul_epu32(all_lanes, ctr2, mult1);
+
+            ctr0 = _mm512_xor_si512(_mm512_xor_si512(_mm512_maskz_srli_epi64(all_lanes, prod1, 32), ctr1),
+                    _mm512_set1_epi64(key0));
+            ctr1 = _mm512_and_si512(prod1, low_word);
+            ctr2 = _mm512_xor_si512(_mm512_xor_si512(_mm512_maskz_srli_epi64(all_lanes, prod0, 32), ctr3),
+                    _mm512_set1_epi64(key1));
+            ctr3 = _mm512_and_si512(prod0, low_word);
+        }
+
+        __m512i words01 = _mm512_or_si512(ctr0, _mm512_maskz_slli_epi64(all_lanes, ctr1, 32));
+        __m512i words23 = _mm512_or_si512(ctr2, _mm512_maskz_slli_epi64(all_lanes, ctr3, 32));
+
+        _mm512_storeu_si512(out + 4 * block_i,
+                _mm512_permutex2var_epi64(words01, blocks_0_3, words23));
+        _mm512_storeu_si512(out + 4 * block_i + 16,
+                _mm512_permutex2var_epi64(words01, blocks_4_7, words23));
+    }
+
+    philox_blocks_scalar(key, first_block + block_i, unit, generation,
+            n_blocks - block_i, out + 4 * block_i);
+}
+
+#endif
+
+// choose the widest kernel the cpu supports
+inline philox_blocks_kernel select_philox_blocks_kernel()
+{
+#ifdef PHILOX_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        return philox_blocks_avx512;
+    }
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return philox_blocks_avx2;
+    }
+#endif
+
+    return philox_blocks_scalar;
+}
+
+// the next n words of a stream, exactly as n calls 
+// of philox_rng_get would give them
+inline void philox_fill(philox_rng & r, uint32_t * out, size_t n)
+{
+    static const philox_blocks_kernel blocks_kernel = select_philox_blocks_kernel();
+
+    size_t word_i = 0;
+
+    // the rest of the current block
+    for (; word_i < n && r.used < 4; ++word_i)
+    {
+        out[word_i] = r.block[r.used++];
+    }
+
+    // whole blocks at once
+    uint64_t n_blocks = (n - word_i) / 4;
+
+    if (n_blocks > 0)
+    {
+        uint64_t block = r.ctr[0] | (uint64_t) r.ctr[1] << 32;
+
+        blocks_kernel(r.key, block, r.ctr[2], r.ctr[3], n_blocks, out + word_i);
+
+        block += n_blocks;
+        r.ctr[0] = (uint32_t) block;
+        r.ctr[1] = (uint32_t) (block >> 32);
+
+        word_i += 4 * n_blocks;
+    }
+
+    // and the start of the next block
+    for (; word_i < n; ++word_i)
+    {
+        out[word_i] = philox_rng_get(r);
+    }
+}
+
+#endif
@@ -0,0 +1,261 @@
+#ifndef RANDOM_BUFFER_H_
+#define RANDOM_BUFFER_H_
+
+// buffered random numbers: rather than generating random numbers one
+// at a time, a philox_buffer generates them in bulk into buffers
+// (see philox_fill), from which the simulation takes them one by one.
+//
+// random words (for uniform numbers and integers) and gaussian
+// deviates come from different substreams of the same stream, so
+// the numbers a buffer hands out depend only on its stream and not
+// on the buffer sizes. Gaussian deviates are made with the ziggurat
+// method (Marsaglia & Tsang 2000 J Stat Softw 5: 8), in the 256 layer
+// version of numpy, which turns 64 random bits into a deviate in over
+// 98% of the cases; the remaining cases need further random numbers,
+// which come from a third substream
+
+#include <vector>
+#include "philox.h"
+
+// substreams of a buffered stream
+enum Philox_Buffer_Substreams
+{
+    SUBSTREAM_WORDS = 0,
+    SUBSTREAM_GAUSSIAN,
+    SUBSTREAM_GAUSSIAN_RETRY
+};
+
+// the layers of the ziggurat: layer 0 is the base (including the
+// tail beyond ZIGGURAT_R), layer 1 the top, and the layers below
+// get wider down to layer 255, which reaches ZIGGURAT_R
+struct ziggurat_tables
+{
+    uint64_t k[256]; // 52 bit values below which x lies within the layer's rectangle
+    double w[256]; // x of a 52 bit value
+    double f[256]; // density at the layer boundaries
+};
+
+const double ZIGGURAT_R = 3.6541528853610088; // start of the tail
+const double ZIGGURAT_V = 0.00492867323399; // area of each layer
+
+// construct the tables (once, see ziggurat())
+inline ziggurat_tables make_ziggurat_tables()
+{
+    ziggurat_tables t;
+
+    const double m = 4503599627370496.0; // 2^52
+
+    double dn = ZIGGURAT_R;
+    double tn = dn;
+    double q = ZIGGURAT_V / exp(-0.5 * dn * dn);
+
+    t.k[0] = (uint64_t) ((dn / q) * m);
+    t.k[1] = 0;
+
+    t.w[0] = q / m;
+    t.w[255] = dn / m;
+
+    t.f[0] = 1.0;
+    t.f[255] = exp(-0.5 * dn * dn);
+
+    for (int layer = 254; layer >= 1; --layer)
+    {
+        dn = sqrt(-2.0 * log(ZIGGURAT_V / dn + exp(-0.5 * dn * dn)));
+
+        t.k[layer + 1] = (uint64_t) ((dn / tn) * m);
+        tn = dn;
+
+        t.f[layer] = exp(-0.5 * dn * dn);
+        t.w[layer] = dn / m;
+    }
+
+    return t;
+}
+
+inline const ziggurat_tables & ziggurat()
+{
+    static const ziggurat_tables tables = make_ziggurat_tables();
+    return tables;
+}
+
+// uniform number in [0,1) with 53 random bits
+inline double philox_rng_uniform53(philox_rng & r)
+{
+    uint32_t high = philox_rng_get(r) >> 5;
+    uint32_t low = philox_rng_get(r) >> 6;
+
+    return (high * 67108864.0 + low) / 9007199254740992.0;
+}
+
+// gaussian deviate from the 64 random bits in bits; when these fall
+// outside the rectangles of the ziggurat, further random numbers
+// are taken from retry
+inline double ziggurat_gaussian(const ziggurat_tables & t,
+        uint64_t bits,
+        philox_rng & retry)
+{
+    for (;;)
+    {
+        int layer = bits & 0xFF;
+        bits >>= 8;
+        bool negative = bits & 1;
+        uint64_t value = (bits >> 1) & 0x000FFFFFFFFFFFFF;
+
+        double x = value * t.w[layer];
+
+        if (negative)
+        {
+            x = -x;
+        }
+
+        // within the rectangle of the layer
+        if (value < t.k[layer])
+        {
+            return x;
+        }
+
+        if (layer == 0)
+        {
+            // the tail: sample from the exponential beyond ZIGGURAT_R
+            for (;;)
+            {
+                double xx = -log1p(-philox_rng_uniform53(retry)) / ZIGGURAT_R;
+                double yy = -log1p(-philox_rng_uniform53(retry));
+
+                if (yy + yy > xx * xx)
+                {
+                    return negative ? -(ZIGGURAT_R + xx) : ZIGGURAT_R + xx;
+                }
+            }
+        }
+
+        // the wedge between the rectangle and the density
+        if ((t.f[layer - 1] - t.f[layer]) * philox_rng_uniform53(retry) + t.f[layer]
+                < exp(-0.5 * x * x))
+        {
+            return x;
+        }
+
+        bits = philox_rng_get(retry) | (uint64_t) philox_rng_get(retry) << 32;
+    }
+}
+
+// a stream with buffers of random words and gaussian deviates
+struct philox_buffer
+{
+    philox_rng words_stream;
+    philox_rng gaussian_stream;
+    philox_rng retry_stream; // for deviates outside the ziggurat's rectangles
+
+    std::vector < uint32_t > words;
+    size_t next_word; // next word to hand out
+
+    std::vector < double > gaussians;
+    size_t next_gaussian;
+
+    std::vector < uint32_t > gaussian_bits; // scratch space, 2 words per deviate
+};
+
+// position a buffered stream at the start of the stream belonging to
+// (seed, purpose, generation, unit), with room for the given number
+// of words and gaussian deviates, which are generated whenever the
+// previous ones are used up (space is only allocated when the buffers
+// need to grow)
+inline void philox_buffer_set(philox_buffer & b,
+        uint32_t seed,
+        uint32_t purpose,
+        uint32_t generation,
+        uint32_t unit,
+        size_t words,
+        size_t gaussians)
+{
+    philox_rng_set(b.words_stream, seed, purpose, generation, unit);
+    philox_rng_set(b.gaussian_stream, seed, purpose, generation, unit);
+    philox_rng_set(b.retry_stream, seed, purpose, generation, unit);
+
+    philox_rng_set_substream(b.words_stream, SUBSTREAM_WORDS);
+    philox_rng_set_substream(b.gaussian_stream, SUBSTREAM_GAUSSIAN);
+    philox_rng_set_substream(b.retry_stream, SUBSTREAM_GAUSSIAN_RETRY);
+
+    b.words.resize(words > 0 ? words : 1);
+    b.next_word = b.words.size();
+
+    b.gaussians.resize(gaussians > 0 ? gaussians : 1);
+    b.next_gaussian = b.gaussians.size();
+    b.gaussian_bits.resize(2 * b.gaussians.size());
+}
+
+inline void philox_buffer_refill_gaussians(philox_buffer & b)
+{
+    const ziggurat_tables & t = ziggurat();
+
+    philox_fill(b.gaussian_stream, &b.gaussian_bits[0], b.gaussian_bits.size());
+
+    for (size_t gauss_i = 0; gauss_i < b.gaussians.size(); ++gauss_i)
+    {
+        uint64_t bits = b.gaussian_bits[2 * gauss_i]
+            | (uint64_t) b.gaussian_bits[2 * gauss_i + 1] << 32;
+
+        b.gaussians[gauss_i] = ziggurat_gaussian(t, bits, b.retry_stream);
+    }
+
+    b.next_gaussian = 0;
+}
+
+// next 32 random bits
+inline uint32_t philox_buffer_get(philox_buffer & b)
+{
+    if (b.next_word == b.words.size())
+    {
+        philox_fill(b.words_stream, &b.words[0], b.words.size());
+        b.next_word = 0;
+    }
+
+    return b.words[b.next_word++];
+}
+
+// uniform number in [0,1)
+inline double philox_buffer_uniform(philox_buffer & b)
+{
+    return philox_buffer_get(b) / 4294967296.0;
+}
+
+// uniform number in (0,1)
+inline double philox_buffer_uniform_pos(philox_buffer & b)
+{
+    return (philox_buffer_get(b) + 0.5) / 4294967296.0;
+}
+
+// uniform integer in [0,n), without modulo bias,
+// see philox_rng_uniform_int
+inline unsigned long philox_buffer_uniform_int(philox_buffer & b, unsigned long n)
+{
+    uint64_t m = (uint64_t) philox_buffer_get(b) * n;
+    uint32_t low = (uint32_t) m;
+
+    if (low < n)
+    {
+        uint32_t threshold = (uint32_t) -n % (uint32_t) n;
+
+        while (low < threshold)
+        {
+            m = (uint64_t) philox_buffer_get(b) * n;
+            low = (uint32_t) m;
+        }
+    }
+
+    return m >> 32;
+}
+
+// gaussian deviate with standard deviation sigma
+inline double philox_buffer_gaussian(philox_buffer & b, double sigma)
+{
+    if (b.next_gaussian == b.gaussians.size())
+    {
+        philox_buffer_refill_gaussians(b);
+    }
+
+    return sigma * b.gaussians[b.next_gaussian++];
+}
+
+#endif
@@ -24,27 +24,48 @@
 #include <string>
 #include <cmath>
 #include <cassert>
+#include <climits>
 #include <vector>
-#include <gsl/gsl_rng.h>
-#include <gsl/gsl_randist.h>
+#include <array>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <cstring>
 #include <termios.h>
 #include <omp.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <sched.h>
+#include "philox.h"
+#include "random_buffer.h"
+#include "worker_kernels.h"
+#include "task_sets.h"
 
 //#define DEBUG
 //#define SIMULTANEOUS_UPDATE
 //#define STOPCODE
 //#define WRITE_LASTGEN_PERSTEP
+//#define CALC_D_PERSTEP // recalculate specialization every timestep, e.g., for per-step traces
+//#define SCALAR_KERNELS // do not use the AVX2/AVX-512 versions of the worker updates
 //---------------------------------------------------------------------------
 
 using namespace std;
 
-// random number generator 
-// see http://www.gnu.org/software/gsl/manual/html_node/Random-Number-Generation.html#Random-Number-Generation 
-gsl_rng_type const * T; // gnu scientific library rng type
-gsl_rng *rng_global; // gnu scientific rng 
+// random number generators
+// all random numbers come from counter-based streams (see philox.h),
+// one for every (seed, purpose, generation, colony) so that results
+// do not depend on the number of threads
+enum Rng_Purpose
+{
+    RNG_WORKERS = 1, // inheritance of the workers of a colony
+    RNG_ECOLOGY, // task choice, quitting and switching of workers
+    RNG_ORDER, // order in which the workers are visited
+    RNG_REPRODUCTION, // pairing of sexuals into new colonies
+    RNG_SEXUALS // production of sexuals, one stream per sexual
+};
 
 
 struct Params
@@ -76,6 +97,13 @@ struct Params
     vector<double> alpha_max; // maximum efficiency with which work is done (when fully experienced)
     vector<double>alpha_min; // minimum efficiency with which work is done (when inexperied)
     vector<double> beta;
+
+    // efficiency tabulated as a function of experience,
+    // see Init_Efficiency_Table()
+    double exp_unit; // experience changes in multiples of this unit
+    double inv_exp_unit; // 1 / exp_unit, to avoid a division per lookup
+    int exp_levels; // number of tabulated experience levels per task (0: no table)
+    vector<double> alpha_table; // indexed by task_i * exp_levels + level
     
     istream & Init_Params(istream & inp);
 
@@ -83,65 +111,257 @@ struct Params
 
 };
 
+// founders and sexuals: only their genome matters
 struct Ant
 {
     // genome
     double learn;
     double forget;
-    // behaviour
+    bool mated; // only for queens, keep track of who is already mated
+};
+
+// all workers of a colony, stored as a structure of arrays:
+// per-ant fields are indexed by ant_i, per-task fields
+// by task_i * N + ant_i, so that the values of one task 
+// lie next to each other in memory and the whole colony
+// can be traversed linearly. The exception are the wanted tasks,
+// a set of tasks per ant (see task_sets.h) at ant_i * want_words
+struct Workers
+{
+    int N; // number of workers
+    unsigned int tasks; // number of tasks
+    unsigned int want_words; // words per set of wanted tasks
+
+    // genome
+    vector < double > learn;
+    vector < double > forget;
+
+    // behaviour, per task
     vector < double > threshold;
     vector < double > alpha; // Strenght with which experience level affects efficiency
     vector < int > countacts;   // counter of acts done by this ant
-    vector < bool > want_task; // whether an individual would accept an offered task (does not mean it will do the task)
+    vector < uint64_t > want_task; // the tasks an individual would accept when offered (does not mean it will do the task)
     vector < double > experience_points; // e_ij in Duarte 2012 chapter 5
-    int last_act; // keep track of the last act that an individual did
-    int curr_act; // keep track of current act an individual is doing
-    int switches; // number transitions to a different task
-    int workperiods; // number of working periods 
-    double D; // specialization value
-    bool mated; // only for queens, keep track of who is already mated
-    double Dx; // Franjo's specialization value
-    int count_time; //COUNTER OF TIMESTEPS TO SWITCH TASK
-    int ID_ant; // individual ID of an ant
+
+    // behaviour, per ant
+    vector < int > last_act; // keep track of the last act that an individual did (NO_ACT if none yet)
+    vector < int > curr_act; // keep track of current act an individual is doing (tasks if idle)
+    vector < int > switches; // number transitions to a different task
+    vector < int > workperiods; // number of working periods 
+    vector < double > D; // specialization value
+    vector < double > Dx; // Franjo's specialization value
+    vector < int > count_time; //COUNTER OF TIMESTEPS TO SWITCH TASK
+
+    // order in which the ants are visited during a timestep
+    // (the ant's index is also its ID)
+    vector < int > order;
+
+    void Resize(int n, unsigned int ntasks);
 };
 
-// declare populations of Workers and Sexuals
-typedef vector < Ant > Workers;
+// value of last_act before a worker has done any task
+const int NO_ACT = -1;
+
+// declare population of Sexuals
 typedef vector < Ant > Sexuals;
 
+// the colony engine is compiled for a fixed number of tasks NT 
+// (see main), so that loops over tasks have a constant trip count
+// and per-task colony data lives in fixed-size arrays. NT == 0 is 
+// the generic version, which takes the number of tasks from the 
+// parameters 
+template <unsigned int NT>
+inline unsigned int Num_Tasks(Params & Par)
+{
+    return NT > 0 ? NT : Par.tasks;
+}
+
+// storage for one value per task
+template <typename T, unsigned int NT>
+struct Per_Task
+{
+    typedef array < T, NT > type;
+};
+
+template <typename T>
+struct Per_Task < T, 0 >
+{
+    typedef vector < T > type;
+};
+
+// set all values of per-task storage 
+// (and for the generic version its size)
+template <typename T, size_t NT, typename V>
+void Reset_Per_Task(array < T, NT > & values, unsigned int ntasks, V value)
+{
+    values.fill(value);
+}
+
+template <typename T, typename V>
+void Reset_Per_Task(vector < T > & values, unsigned int ntasks, V value)
+{
+    values.assign(ntasks, value);
+}
+
+// parameter regimes in which parts of the task choice no longer 
+// depend on chance, or can be decided with fewer random numbers. 
+// The task choice functions take these flags as the template 
+// parameter R, so that in such a regime the branches that cannot 
+// be taken are compiled away and no random numbers are drawn for
+// decisions whose outcome is already known
+enum Regime_Flags
+{
+    QUIT_ALWAYS = 1, // p == 1: working ants always quit
+    WAIT_ALWAYS = 2, // p_wait == 1: switching ants always wait while count_time < timecost
+    WAIT_NEVER = 4, // timecost == 0: switching ants never wait
+    NO_NOISE = 8, // threshold_noise == 0: thresholds are compared without noise
+    QUIT_BATCHED = 16 // p < 1: skip ahead to the next working ant that quits, see Quits()
+};
+
+// the regime belonging to a set of parameters
+unsigned int Regime_Of(Params & Par)
+{
+    unsigned int regime = 0;
+
+    if (Par.p >= 1)
+    {
+        regime |= QUIT_ALWAYS;
+    }
+    else
+    {
+        regime |= QUIT_BATCHED;
+    }
+
+    if (Par.timecost <= 0)
+    {
+        regime |= WAIT_NEVER;
+    }
+    else if (Par.p_wait >= 1)
+    {
+        regime |= WAIT_ALWAYS;
+    }
+
+    if (Par.threshold_noise == 0)
+    {
+        regime |= NO_NOISE;
+    }
+
+    return regime;
+}
+
+string Regime_Name(unsigned int regime)
+{
+    string name = "general";
+
+    if (regime != 0)
+    {
+        name = "";
+        name += (regime & QUIT_ALWAYS) ? " quit_always" : "";
+        name += (regime & QUIT_BATCHED) ? " quit_batched" : "";
+        name += (regime & WAIT_ALWAYS) ? " wait_always" : "";
+        name += (regime & WAIT_NEVER) ? " wait_never" : "";
+        name += (regime & NO_NOISE) ? " no_noise" : "";
+        name = name.substr(1);
+    }
+
+    return name;
+}
+
 
 // ok, define a colonoy
-struct Colony
+//
+// a Colony is the workspace in which a single colony is simulated
+// during a generation. Each thread owns one, which is reused for
+// all the colonies that thread simulates. Aligned to a cache line
+// so that the workspaces of different threads never share one.
+template <unsigned int NT>
+struct alignas(64) Colony
 {
     Workers MyAnts; // ants in the colony
     Ant male, queen; // king & queen
     int ID; // id of the colony
     
-    vector<double> stim; // the different stimuli for the various tasks in the colony 
-    vector<double> newstim; // I don't know
+    typename Per_Task < double, NT >::type stim; // the different stimuli for the various tasks in the colony 
+    typename Per_Task < double, NT >::type newstim; // I don't know
 
-    vector<double> workfor;  // number acts * eff each time step
-    vector < int > numacts_step; // number of acts performed per task each time step
-    vector < int > numacts_total; // number of total acts performed per task
+    typename Per_Task < double, NT >::type workfor;  // number acts * eff each time step
+    typename Per_Task < int, NT >::type numacts_step; // number of acts performed per task each time step
+    typename Per_Task < int, NT >::type numacts_total; // number of total acts performed per task
+
+    // scratch space for WantTask: an ant's thresholds + noise
+    // and the set of tasks she wants to do
+    typename Per_Task < double, NT >::type noisy_threshold;
+    typename Per_Task < uint64_t, (NT + 63) / 64 >::type wanted;
 
     double idle; // proportion workers that _never_ worked in the simulation 
     double inactive; // proportion workers that were idle each time step
 
-    vector <double> fitness_work; //number of acts * eff performed in the time steps counting for fitness 
+    typename Per_Task < double, NT >::type fitness_work; //number of acts * eff performed in the time steps counting for fitness 
     double fitness;
-    double rel_fit; // fitness relative to whole population
-    double cum_fit; //cumulative fitness
 
     // number of acts performed per task each time step
     // yet only counted in the interval that colony productivity is counted
     // i.e., maxtime - tau
+    typename Per_Task < double, NT >::type mean_work_alloc; 
+
+    double mean_D;
+    double var_D;
+    double mean_Dx;
+    double var_Dx;
+    double mean_switches;
+    double var_switches;
+    double mean_workperiods;
+    double var_workperiods;
+
+    // running sums over all ants that worked more than once,
+    // kept up to date by Update_Ants, see Update_Spec_Sums()
+    long spec_active;
+    long sum_switches;
+    long sumsquares_switches;
+    long sum_workperiods;
+    long sumsquares_workperiods;
+
+    // scratch space for Inherit_Workers
+    vector < uint32_t > inherit_bits;
+
+    // number of working ants still to be visited in this timestep
+    // before the next one that quits (QUIT_BATCHED regime only)
+    long quit_skip;
+
+    // buffered random numbers for the ecology and for the order 
+    // in which the ants are visited, see Simulate_Colony
+    philox_buffer rng_ecology;
+    philox_buffer rng_order;
+
+    // per-step trace of the colony, see Trace_Step
+    ostringstream trace;
+    int trace_until; // timesteps before this one are traced
+    int trace_dx_side; // side of the trigger mean Dx was on: -1 below, 1 above, 0 unknown
+};
+
+// what is kept of a colony once its generation has been simulated:
+// its founders and the results needed for reproduction and output
+struct ColonySummary
+{
+    Ant male, queen; // king & queen
+
+    vector<double> stim; // stimulus levels at the end of the generation
+    vector < int > numacts_step; // number of acts performed per task in the last time step
+
+    double idle; // proportion workers that _never_ worked in the simulation 
+    double inactive; // proportion workers that were idle each time step
+
+    vector <double> fitness_work; //number of acts * eff performed in the time steps counting for fitness 
+    double fitness;
+    double rel_fit; // fitness relative to whole population
+    double cum_fit; //cumulative fitness
+
     vector<double> mean_work_alloc; 
 
     double mean_D;
     double var_D;
     double mean_Dx;
     double var_Dx;
-    int num_offspring;
     double mean_switches;
     double var_switches;
     double mean_workperiods;
@@ -149,13 +369,114 @@ struct Colony
 };
 
 // define a population of colonies
-typedef vector < Colony > Population;
+typedef vector < ColonySummary > Population;
+
+// how colonies are distributed over threads, 
+// set from the command line (see Init_Run_Options)
+struct Run_Options
+{
+    int num_threads; // number of threads that simulate colonies
+    omp_sched_t schedule; // static, dynamic or guided
+    int chunk; // colonies handed out to a thread at once (0: OpenMP default)
+    bool pin; // pin each thread to its own core
+    bool check_regime; // only check the regime's engine against the general one
+    int stop_window; // generations per window of the convergence test (0: run all generations)
+    double stop_tolerance; // allowed drift between windows, in standard deviations of the alleles
+};
+
+// which timesteps of which colonies are written to ant_beh_<simpart>.txt 
+// (see Write_Ants_Beh), set from the command line (see Init_Trace_Policy).
+// A timestep is traced when its colony and generation are within 
+// range, it is a multiple of every and, with a trigger, it lies in 
+// the window of timesteps after the colony's mean Dx crossed the trigger
+struct Trace_Policy
+{
+    bool on; // trace at all
+    int every; // trace every k-th timestep
+    int first_colony, last_colony;
+    int first_generation, last_generation;
+    bool triggered; // only trace after mean Dx crosses dx_trigger
+    double dx_trigger;
+    int window; // number of timesteps traced after a crossing
+};
+
+// the founders' allele distribution over the generations of 
+// this run, to stop the run once it no longer changes, see Converged()
+struct Convergence_Monitor
+{
+    // per generation, for learn [0] and forget [1]:
+    // mean and variance over all founders
+    vector < double > mean[2];
+    vector < double > var[2];
+
+    // outcome of the last test, per allele: change of the mean and 
+    // of the standard deviation between the last two windows, 
+    // and the standard deviation over both windows
+    double mean_drift[2];
+    double sd_drift[2];
+    double sd[2];
+};
+
+// the data of one generation's colonies, to be written to the data
+// files by the writer thread (see Start_Writer)
+struct Output_Batch
+{
+    int generation;
+    Population colonies;
+};
+
+// the writer thread writes the data files while the simulation 
+// goes on with the next generation. Batches circulate between
+// the simulation, which fills free batches, and the writer, which 
+// writes full ones: when the writer falls behind, the simulation 
+// waits for a free batch
+struct Output_Writer
+{
+    thread worker;
+    mutex lock;
+    condition_variable changed; // a batch became free or full, or the writer is done
+
+    vector < Output_Batch > batches;
+    vector < Output_Batch * > free; // batches that can be filled
+    deque < Output_Batch * > full; // batches to be written, oldest first
+    int writing; // batches being written
+    bool stop; // no more batches will come
+
+    Params * Par;
+    ofstream * out_col; // data_work_alloc
+    ofstream * out_alleles; // allele_distrib
+    ofstream * out_f; // f_dist
+};
+
+// binary checkpoint from which a run continues exactly where the 
+// previous part left off, see Write_Checkpoint(). As every random 
+// number stream is determined by (seed, purpose, generation, unit), 
+// the seed and the next generation give the state of all streams.
+//
+// layout (native byte order): the header, followed by the founders 
+// of the next generation (male learn, male forget, queen learn, 
+// queen forget per colony) and the convergence history (learn means, 
+// learn variances, forget means, forget variances), all as doubles
+const char CHECKPOINT_MAGIC[8] = "RTCHKPT";
+const uint32_t CHECKPOINT_VERSION = 1;
+
+struct Checkpoint_Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t seed;
+    int32_t simpart; // part that wrote the checkpoint
+    int32_t generation; // next generation to simulate
+    int32_t colonies;
+    int32_t monitored; // generations in the convergence history
+    uint64_t checksum; // FNV-1a of everything after the header
+};
 
 // Sexual individuals that are going to found a new colony
 Sexuals mySexuals;
 
-// keep track of the ID of the parental colony
-vector <int> parentCol;
+// the timesteps to trace, see Init_Trace_Policy
+Trace_Policy trace_policy;
 
 // some stats
 double sum_fitness = 0;
@@ -181,9 +502,35 @@ int mygetch(void)
 
 // initialize the parameters from a textfile file in the local folder
 // which is all generated through python
-istream & Params::Init_Params(istream & in)
+//
+// the file has one parameter per line: 21 general parameters and 
+// 5 per task (meanT, delta, alpha_max, alpha_min and beta), so the 
+// number of tasks follows from the number of lines
+istream & Params::Init_Params(istream & in_file)
 {
-    tasks = 2; 
+    string contents, line;
+    int num_lines = 0;
+
+    while (getline(in_file, line))
+    {
+        if (!line.empty())
+        {
+            contents += line + "\n";
+            ++num_lines;
+        }
+    }
+
+    if (num_lines < 21 + 2 * 5 || (num_lines - 21) % 5 != 0)
+    {
+        cout << "error: params.txt has " << num_lines 
+            << " lines, expected 21 + 5 per task (at least 2 tasks)" << endl;
+        exit(1);
+    }
+
+    tasks = (num_lines - 21) / 5; 
+
+    istringstream in(contents);
+
     meanT.reserve(tasks);
     delta.reserve(tasks);
     alpha_max.reserve(tasks);
@@ -428,7 +775,35 @@ istream & Params::Init_Params(istream & in)
     getline(in, tmp); 
     tmp="";
 
-    return in;
+    return in_file;
+}
+
+// allocate space for n workers and ntasks tasks
+// (a no-op when the store already has this size)
+void Workers::Resize(int n, unsigned int ntasks)
+{
+    N = n;
+    tasks = ntasks;
+    want_words = task_set_words(tasks);
+
+    learn.resize(N);
+    forget.resize(N);
+
+    threshold.resize(N * tasks);
+    alpha.resize(N * tasks);
+    countacts.resize(N * tasks);
+    want_task.resize(N * want_words);
+    experience_points.resize(N * tasks);
+
+    last_act.resize(N);
+    curr_act.resize(N);
+    switches.resize(N);
+    workperiods.resize(N);
+    D.resize(N);
+    Dx.resize(N);
+    count_time.resize(N);
+
+    order.resize(N);
 }
 
 //=================================================================================================================
@@ -518,6 +893,117 @@ void Read_LastGen_Data(istream & in, Params & Par, Population & Pop)
     }
 }
 
+// 64 bit FNV-1a hash, to detect damaged checkpoints
+uint64_t Checksum(const unsigned char * data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t byte_i = 0; byte_i < size; ++byte_i)
+    {
+        hash ^= data[byte_i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+// continue from the checkpoint written by the previous part:
+// the file is mapped into memory rather than parsed
+void Read_Checkpoint(const char * filename, 
+        Params & Par, 
+        Population & Pop, 
+        Convergence_Monitor & Mon)
+{
+    int fd = open(filename, O_RDONLY);
+
+    struct stat file_info;
+
+    if (fd < 0 || fstat(fd, &file_info) != 0)
+    {
+        cout << "error: cannot open " << filename << endl;
+        exit(1);
+    }
+
+    size_t size = file_info.st_size;
+
+    if (size < sizeof(Checkpoint_Header))
+    {
+        cout << "error: " << filename << " is not a checkpoint" << endl;
+        exit(1);
+    }
+
+    void * mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (mapped == MAP_FAILED)
+    {
+        cout << "error: cannot map " << filename << endl;
+        exit(1);
+    }
+
+    Checkpoint_Header header;
+    memcpy(&header, mapped, sizeof(header));
+
+    const unsigned char * payload = 
+        (const unsigned char *) mapped + sizeof(header);
+    size_t payload_size = size - sizeof(header);
+
+    if (memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0 
+            || header.version != CHECKPOINT_VERSION)
+    {
+        cout << "error: " << filename << " is not a version " 
+            << CHECKPOINT_VERSION << " checkpoint" << endl;
+        exit(1);
+    }
+
+    if (header.colonies != Par.Col)
+    {
+        cout << "error: checkpoint has " << header.colonies 
+            << " colonies, params.txt " << Par.Col << endl;
+        exit(1);
+    }
+
+    if (payload_size != (4 * (size_t) header.colonies + 4 * (size_t) header.monitored) * sizeof(double)
+            || Checksum(payload, payload_size) != header.checksum)
+    {
+        cout << "error: " << filename << " is damaged" << endl;
+        exit(1);
+    }
+
+    if (header.seed != (uint32_t) Par.seed)
+    {
+        cout << "warning: seed differs from that of the checkpoint, "
+            << "the run does not continue the previous one exactly" << endl;
+    }
+
+    simpart = header.simpart + 1;
+    simstart_generation = header.generation;
+
+    vector < double > values(payload_size / sizeof(double));
+    memcpy(&values[0], payload, payload_size);
+
+    munmap(mapped, size);
+    close(fd);
+
+    double * value = &values[0];
+
+    for (unsigned int col_i = 0; col_i < Pop.size(); ++col_i)
+    {
+        Pop[col_i].male.learn = *value++;
+        Pop[col_i].male.forget = *value++;
+        Pop[col_i].queen.learn = *value++;
+        Pop[col_i].queen.forget = *value++;
+    }
+
+    for (int allele_i = 0; allele_i < 2; ++allele_i)
+    {
+        Mon.mean[allele_i].assign(value, value + header.monitored);
+        value += header.monitored;
+
+        Mon.var[allele_i].assign(value, value + header.monitored);
+        value += header.monitored;
+    }
+}
+
 void Show_Colonies(Population &Pop)
 {
     for (unsigned int col = 0; 
@@ -532,21 +1018,39 @@ void Show_Colonies(Population &Pop)
 
 //============================================================================================
 
-void Show_Ants(Colony & anyCol)
+template <unsigned int NT>
+void Show_Ants(Colony<NT> & anyCol)
 {
+    Workers & W = anyCol.MyAnts;
+
     cout << "=======================================" << endl;
     cout << "Current values of:" << endl; 
     cout << "\t" << endl;
-    for (unsigned int ant=0; ant < anyCol.MyAnts.size(); ant++)
+    for (int ant=0; ant < W.N; ant++)
 	{
 	    cout << "ant " << ant << endl;
         cout << "\t" << endl;
-	    cout << "count acts " << anyCol.MyAnts[ant].countacts[0] << "\t" << anyCol.MyAnts[ant].countacts[1]  << endl;
-        cout << "thresholds " << anyCol.MyAnts[ant].threshold[0] << "\t" << anyCol.MyAnts[ant].threshold[1] << endl;
-        cout << "effic " << anyCol.MyAnts[ant].alpha[0] << "\t" << anyCol.MyAnts[ant].alpha[1] << endl;
-	    cout << "D " << anyCol.MyAnts[ant].D << endl; // specialization value
-	    cout << "switches " << anyCol.MyAnts[ant].switches << endl;
-	    cout << "workperiods " << anyCol.MyAnts[ant].workperiods << endl;
+	    cout << "count acts";
+        for (unsigned int task = 0; task < W.tasks; ++task)
+        {
+            cout << "\t" << W.countacts[task * W.N + ant];
+        }
+        cout << endl;
+        cout << "thresholds";
+        for (unsigned int task = 0; task < W.tasks; ++task)
+        {
+            cout << "\t" << W.threshold[task * W.N + ant];
+        }
+        cout << endl;
+        cout << "effic";
+        for (unsigned int task = 0; task < W.tasks; ++task)
+        {
+            cout << "\t" << W.alpha[task * W.N + ant];
+        }
+        cout << endl;
+	    cout << "D " << W.D[ant] << endl; // specialization value
+	    cout << "switches " << W.switches[ant] << endl;
+	    cout << "workperiods " << W.workperiods[ant] << endl;
         cout << "\t" << endl;
 	}
 }
@@ -608,26 +1112,12 @@ void Show_Params(Params & Par)
 void Init_Founders_Generation_0(Population &Pop, Params &Par)
 {
 #ifdef DEBUG  
-    // some bits are taylored for two tasks so we have to throw this assert for now
-    assert(Par.tasks==2);
     cout <<Par.Col << endl;
 #endif
     Pop.resize(Par.Col);
     //cout << "Initializing founders!" << endl;
     for (unsigned int i = 0; i < Pop.size(); i++)
     {
-        // now specify the sizes of the threshold vectors for the 
-        // number of tasks which you define in the parameter file
-        Pop[i].male.threshold.resize(Par.tasks);
-        Pop[i].queen.threshold.resize(Par.tasks);
-
-        // set the initial thresholds for each individual
-        for (unsigned int task=0; task<Par.tasks; task++)
-        {
-            Pop[i].male.threshold[task]= Par.meanT[task];
-            Pop[i].queen.threshold[task]= Par.meanT[task];
-        }
-
         // set the initial learn and forget values for the colony
         Pop[i].male.learn = Par.initLearn;
         Pop[i].male.forget = Par.initForget;
@@ -642,234 +1132,374 @@ void Init_Founders_Generation_0(Population &Pop, Params &Par)
 //=============================================================================
 //end of Init_Founders_Generation_0()
 
-void Mutation(double & trait, double & parent, Params &Par, gsl_rng *rng_r)
+void Mutation(double & trait, double & parent, Params &Par, philox_rng & rng_r)
     {
-        if (Par.mutp > gsl_rng_uniform(rng_r))
-            trait = parent + gsl_ran_gaussian(rng_r, Par.mutstep);
+        if (Par.mutp > philox_rng_uniform(rng_r))
+            trait = parent + philox_ran_gaussian(rng_r, Par.mutstep);
         else trait = parent;
     }
 
 //==============================================================================
 //end of Mutation()
-void Inherit(Ant &Daughter, Ant &Mom, Ant &Dad, Params &Par, gsl_rng *rng_r)
+// the daughter's learn and forget alleles are written
+// to learn and forget
+void Inherit(double &learn, double &forget, Ant &Mom, Ant &Dad, Params &Par, philox_rng & rng_r)
 {
-    double rec = gsl_rng_uniform(rng_r);
+    double rec = philox_rng_uniform(rng_r);
 
     // ok, full recombination 
     if (rec < Par.recomb)
     {
         // with probabability 0.5, mom transmits learn
         // dad transmits forget
-        if (gsl_rng_uniform(rng_r) < 0.5)
+        if (philox_rng_uniform(rng_r) < 0.5)
         {
-            Mutation(Daughter.learn, Mom.learn, Par, rng_r);
-            Mutation(Daughter.forget, Dad.forget, Par, rng_r); 
+            Mutation(learn, Mom.learn, Par, rng_r);
+            Mutation(forget, Dad.forget, Par, rng_r); 
         }
         else // with prob 0.5 vice versa
         {
-            Mutation(Daughter.learn, Dad.learn, Par, rng_r);
-            Mutation(Daughter.forget, Mom.forget, Par, rng_r);
+            Mutation(learn, Dad.learn, Par, rng_r);
+            Mutation(forget, Mom.forget, Par, rng_r);
         }
     } 
     else  // no recombination
     {
-        if (gsl_rng_uniform(rng_r) < 0.5)
+        if (philox_rng_uniform(rng_r) < 0.5)
         {
-            Mutation(Daughter.learn, Mom.learn, Par, rng_r);
-            Mutation(Daughter.forget, Mom.forget, Par, rng_r);
+            Mutation(learn, Mom.learn, Par, rng_r);
+            Mutation(forget, Mom.forget, Par, rng_r);
         }
         else 
         {
-            Mutation(Daughter.learn, Dad.learn, Par, rng_r);
-            Mutation(Daughter.forget, Dad.forget, Par, rng_r);
+            Mutation(learn, Dad.learn, Par, rng_r);
+            Mutation(forget, Dad.forget, Par, rng_r);
         }
     }
 
     // values for learning and forgetting cannot be negative
-    if (Daughter.learn < 0)
+    if (learn < 0)
     {
-        Daughter.learn = 0;
+        learn = 0;
     }
 
-    if (Daughter.forget < 0) 
+    if (forget < 0) 
     {
-        Daughter.forget = 0;
+        forget = 0;
     }
 
 } // end of Inherit
 
-//=======================================================================================
-
-// update performance efficiency 
-// performance efficiency for task i is alpha_i
-// where
-// alpha_i = alpha_max * alpha_min * exp(K * eij) / (alpha_min * exp(K * eij) + 1-alpha_min)
-//
-// see Otto & Day ch 4 for specication of sigmoidal
-// K affects steepness of sigmoidal
-void UpdateEfficiency(Ant & anyAnt, Params & Par)
+// the learn and forget alleles of all workers of a colony, inherited 
+// from its founders as in Inherit, but for all workers at once:
+// - the parent that transmits each allele is chosen from random
+//   words generated in bulk, two per worker
+// - rather than drawing a random number per allele to decide whether
+//   it mutates, the number of alleles skipped before the next mutation
+//   is drawn (geometrically distributed), going through the learn 
+//   alleles of all workers and then through their forget alleles
+template <unsigned int NT>
+void Inherit_Workers(Colony<NT> & Col, Params & Par, philox_rng & rng_r)
 {
-    for (unsigned int task_i = 0; task_i < Par.tasks; ++task_i)
+    Workers & W = Col.MyAnts;
+    Ant & Mom = Col.queen;
+    Ant & Dad = Col.male;
+
+    Col.inherit_bits.resize(2 * W.N);
+    philox_fill(rng_r, &Col.inherit_bits[0], 2 * W.N);
+
+    for (int ant_i = 0; ant_i < W.N; ++ant_i)
     {
-        double tmp_1 = Par.K * anyAnt.experience_points[task_i];
-        double tmp_2 = Par.alpha_min[task_i] * exp(tmp_1);
+        // with full recombination, learn and forget come from different
+        // parents, otherwise from the same, each parent with probability 0.5
+        bool recombine = Col.inherit_bits[2 * ant_i] / 4294967296.0 < Par.recomb;
+        bool learn_from_mom = Col.inherit_bits[2 * ant_i + 1] < 2147483648u;
+        bool forget_from_mom = learn_from_mom != recombine;
+
+        W.learn[ant_i] = learn_from_mom ? Mom.learn : Dad.learn;
+        W.forget[ant_i] = forget_from_mom ? Mom.forget : Dad.forget;
+    }
+
+    long num_alleles = 2 * W.N;
+
+    for (long allele_i = -1;;)
+    {
+        long skip = geometric_skip(Par.mutp, philox_rng_uniform_pos(rng_r));
+
+        if (skip >= num_alleles - allele_i - 1)
+        {
+            break;
+        }
+
+        allele_i += skip + 1;
 
-        anyAnt.alpha[task_i] = Par.alpha_max[task_i] * tmp_2 / 
-            (tmp_2 + (1 - Par.alpha_min[task_i])); 
+        double & allele = allele_i < W.N ? 
+            W.learn[allele_i] : W.forget[allele_i - W.N];
+
+        allele += philox_ran_gaussian(rng_r, Par.mutstep);
     }
 
+    // values for learning and forgetting cannot be negative
+    for (int ant_i = 0; ant_i < W.N; ++ant_i)
+    {
+        W.learn[ant_i] = max(W.learn[ant_i], 0.0);
+        W.forget[ant_i] = max(W.forget[ant_i], 0.0);
+    }
 }
-// end UpdateEfficiency
-//=======================================================================================================================
-//
 
+//=======================================================================================
+
+// efficiency of a worker with a given level of experience in task_i (see efficiency_direct)
+double Efficiency_Direct(Params & Par, unsigned int task_i, double experience)
+{
+    return efficiency_direct(Par.K, 
+            Par.alpha_min[task_i], 
+            Par.alpha_max[task_i], 
+            experience);
+}
 
-// now initialize an ant
-void Init_Ants(Ant & myAnt, Params & Par, Colony & myCol, int numID, gsl_rng *rng_r)
+// experience only changes by step_gain_exp and step_lose_exp and is
+// bounded below by 0, so it always is an integer multiple of the 
+// largest unit that divides both stepsizes. Tabulate the efficiency 
+// at each of these levels once, rather than calling exp() for every 
+// worker, task and timestep.
+//
+// If the ratio of the stepsizes is not a simple fraction
+// (denominator > max_denominator), no table is made and 
+// all efficiencies are evaluated directly
+void Init_Efficiency_Table(Params & Par)
 {
-    myAnt.ID_ant = numID;
-    myAnt.threshold.resize(Par.tasks);
-    myAnt.alpha.resize(Par.tasks);
-    myAnt.experience_points.resize(Par.tasks);
+    int max_denominator = 1000;
+    int max_levels = 1 << 20;
 
-    for (unsigned int task=0; task < Par.tasks; ++task)
-    {
-        myAnt.threshold[task]= Par.meanT[task];
-        myAnt.experience_points[task] = 0;
-    }
+    double gain = Par.step_gain_exp;
+    double lose = Par.step_lose_exp;
 
-    if (Par.maxgen > 1)
+    Par.exp_unit = 0;
+    Par.inv_exp_unit = 0;
+    Par.exp_levels = 0;
+    Par.alpha_table.clear();
+
+    if (gain <= 0)
     {
-        Inherit(myAnt, myCol.queen, myCol.male, Par, rng_r);
+        // experience never leaves 0
+        Par.exp_unit = 1;
     }
-    else 
+    else if (lose <= 0)
     {
-        myAnt.learn= Par.initLearn;
-        myAnt.forget = Par.initForget;
+        Par.exp_unit = gain;
     }
+    else
+    {
+        // find the smallest n_lose such that 
+        // gain / lose == n_gain / n_lose for an integer n_gain
+        double ratio = gain / lose;
+
+        for (int n_lose = 1; n_lose <= max_denominator; ++n_lose)
+        {
+            double n_gain = round(ratio * n_lose);
 
-    myAnt.countacts.resize(Par.tasks);
-    myAnt.want_task.resize(Par.tasks);
+            if (n_gain >= 1 && fabs(ratio * n_lose - n_gain) < 1e-9 * n_lose)
+            {
+                Par.exp_unit = lose / n_lose;
+                break;
+            }
+        }
+    }
 
-    for (unsigned int task = 0; task < Par.tasks; ++task)
+    if (Par.exp_unit <= 0)
     {
-        myAnt.countacts[task]=0;
-        myAnt.want_task[task]=false;
+        return;
     }
 
-    myAnt.last_act = 7; // initiate it at an impossible value for a task, because 0 is a task
+    Par.inv_exp_unit = 1.0 / Par.exp_unit;
 
-    // set current act to a value
-    // beyond the actual tasks, indicating that the worker
-    // is currently idle
-    myAnt.curr_act = Par.tasks; 
-    myAnt.switches = 0;
-    myAnt.workperiods=0;
-    myAnt.D = 10;
-    myAnt.Dx = 10;
-    myAnt.mated = false;
-    myAnt.count_time=0;
-    UpdateEfficiency(myAnt, Par); 
-}
+    // within a colony experience never exceeds maxtime * step_gain_exp
+    double top_level = round(Par.maxtime * max(gain, 0.0) * Par.inv_exp_unit);
 
+    Par.exp_levels = top_level + 1 < max_levels ? int(top_level) + 1 : max_levels;
 
-//------------------------------------------------------------------------------------
+    Par.alpha_table.resize(Par.tasks * Par.exp_levels);
 
-// initialize a colony from sexuals
-void Init_Colony(Colony & Col, 
-        unsigned int colony_number, 
-        Params & Par,
-        gsl_rng *rng_r)
+    for (unsigned int task_i = 0; task_i < Par.tasks; ++task_i)
+    {
+        for (int level = 0; level < Par.exp_levels; ++level)
+        {
+            Par.alpha_table[task_i * Par.exp_levels + level] = 
+                Efficiency_Direct(Par, task_i, level * Par.exp_unit);
+        }
+    }
+}
+
+// the part of the efficiency table belonging to task_i
+efficiency_lookup Efficiency_Lookup(Params & Par, unsigned int task_i)
 {
-    // resize the colony population to fit N individuals
-    Col.MyAnts.resize(Par.N);
+    efficiency_lookup eff;
 
-    // give colony particular id (for debugging purposes)
-    Col.ID = colony_number;
+    eff.table = Par.exp_levels > 0 ? 
+        &Par.alpha_table[task_i * Par.exp_levels] : NULL;
+    eff.levels = Par.exp_levels;
+    eff.inv_unit = Par.inv_exp_unit;
+    eff.K = Par.K;
+    eff.alpha_min = Par.alpha_min[task_i];
+    eff.alpha_max = Par.alpha_max[task_i];
 
-    // set colony fitness to 0
-    Col.fitness = 0;
-    Col.rel_fit = 0;
-    Col.cum_fit = 0;
+    return eff;
+}
 
-    // set counter of idle workers to 0
-    Col.idle = 0;
-    Col.inactive = 0;
+// look up the efficiency in the table, falling back to direct
+// evaluation when the experience is not (within rounding error)
+// on one of the tabulated levels
+inline double Efficiency(Params & Par, unsigned int task_i, double experience)
+{
+    return efficiency_eval(Efficiency_Lookup(Par, task_i), experience);
+}
 
-    // various specialization measurements
-    Col.mean_D = 10; 
-    Col.var_D=0;
-    Col.mean_Dx = 10;
-    Col.var_Dx = 0;
-    Col.mean_switches = 0;
+// update performance efficiency 
+// performance efficiency for task i is alpha_i
+// where
+// alpha_i = alpha_max * alpha_min * exp(K * eij) / (alpha_min * exp(K * eij) + 1-alpha_min)
+//
+// see Otto & Day ch 4 for specication of sigmoidal
+// K affects steepness of sigmoidal
+//
+// runs over all the workers of the colony in one go
+template <unsigned int NT>
+void UpdateEfficiency(Workers & W, Params & Par)
+{
+    for (unsigned int task_i = 0; task_i < Num_Tasks<NT>(Par); ++task_i)
+    {
+        double * alpha = &W.alpha[task_i * W.N];
+        double * experience_points = &W.experience_points[task_i * W.N];
+
+        for (int ant_i = 0; ant_i < W.N; ++ant_i)
+        {
+            alpha[ant_i] = Efficiency(Par, task_i, experience_points[ant_i]);
+        }
+    }
+
+}
+// end UpdateEfficiency
+//=======================================================================================================================
+//
+
+
+// now initialize an ant (her genome is set by Init_Colony)
+template <unsigned int NT>
+void Init_Ants(Workers & W, int ant_i, Params & Par)
+{
+    for (unsigned int task=0; task < Num_Tasks<NT>(Par); ++task)
+    {
+        W.threshold[task * W.N + ant_i] = Par.meanT[task];
+        W.experience_points[task * W.N + ant_i] = 0;
+    }
+
+    for (unsigned int task = 0; task < Num_Tasks<NT>(Par); ++task)
+    {
+        W.countacts[task * W.N + ant_i] = 0;
+    }
+
+    task_set_clear(&W.want_task[ant_i * W.want_words], W.want_words);
+
+    W.last_act[ant_i] = NO_ACT; // initiate it at an impossible value for a task, because 0 is a task
+
+    // set current act to a value
+    // beyond the actual tasks, indicating that the worker
+    // is currently idle
+    W.curr_act[ant_i] = Num_Tasks<NT>(Par); 
+    W.switches[ant_i] = 0;
+    W.workperiods[ant_i] = 0;
+    W.D[ant_i] = 10;
+    W.Dx[ant_i] = 10;
+    W.count_time[ant_i] = 0;
+
+    // ants are visited in order of their index
+    // until the first shuffle
+    W.order[ant_i] = ant_i;
+}
+
+
+//------------------------------------------------------------------------------------
+
+// initialize a colony from sexuals
+template <unsigned int NT>
+void Init_Colony(Colony<NT> & Col, 
+        unsigned int colony_number, 
+        Ant & queen,
+        Ant & male,
+        Params & Par,
+        philox_rng & rng_r)
+{
+    // give colony particular id (for debugging purposes)
+    Col.ID = colony_number;
+
+    // the founders from which all workers inherit
+    Col.queen = queen;
+    Col.male = male;
+
+    // set colony fitness to 0
+    Col.fitness = 0;
+
+    // set counter of idle workers to 0
+    Col.idle = 0;
+    Col.inactive = 0;
+
+    // various specialization measurements
+    Col.mean_D = 10; 
+    Col.var_D=0;
+    Col.mean_Dx = 10;
+    Col.var_Dx = 0;
+    Col.mean_switches = 0;
     Col.var_switches = 0;
     Col.mean_workperiods=0;
     Col.var_workperiods=0;
 
-    // empty pools of workers, statistics, etc
-    Col.workfor.erase(
-            Col.workfor.begin(),
-            Col.workfor.end());
-
-    Col.fitness_work.erase(
-            Col.fitness_work.begin(),
-            Col.fitness_work.end());
-
-    Col.numacts_step.erase(
-            Col.numacts_step.begin(),
-            Col.numacts_step.end());
-
-    Col.numacts_total.erase(
-            Col.numacts_total.begin(),
-            Col.numacts_total.end());
-
-    Col.stim.erase(
-            Col.stim.begin(),
-            Col.stim.end());
-
-    Col.newstim.erase(
-            Col.newstim.begin(),
-            Col.newstim.end());
-
-    Col.mean_work_alloc.erase(
-            Col.mean_work_alloc.begin(),
-            Col.mean_work_alloc.end());
-
-    // allocate space in the various arrays
-    Col.workfor.reserve(Par.tasks);
-    Col.fitness_work.reserve(Par.tasks);
-    Col.numacts_step.reserve(Par.tasks);
-    Col.numacts_total.reserve(Par.tasks);
-    Col.stim.reserve(Par.tasks);
-    Col.newstim.reserve(Par.tasks);
-    Col.mean_work_alloc.reserve(Par.tasks);
-
-    // put an initial 0 in the vector
-    for (unsigned int task_i = 0; task_i < Par.tasks; ++task_i)
-    {
-        Col.workfor.push_back(0);
-        Col.fitness_work.push_back(0);
-        Col.numacts_step.push_back(0);
-        Col.numacts_total.push_back(0);
-        Col.stim.push_back(Par.initStim);
-        Col.newstim.push_back(0);
-        Col.mean_work_alloc.push_back(0);
-    }
+    Col.spec_active = 0;
+    Col.sum_switches = 0;
+    Col.sumsquares_switches = 0;
+    Col.sum_workperiods = 0;
+    Col.sumsquares_workperiods = 0;
+
+    // reset the various arrays. As the workspace is reused 
+    // from colony to colony, this only allocates the first time
+    Reset_Per_Task(Col.workfor, Num_Tasks<NT>(Par), 0);
+    Reset_Per_Task(Col.fitness_work, Num_Tasks<NT>(Par), 0);
+    Reset_Per_Task(Col.numacts_step, Num_Tasks<NT>(Par), 0);
+    Reset_Per_Task(Col.numacts_total, Num_Tasks<NT>(Par), 0);
+    Reset_Per_Task(Col.stim, Num_Tasks<NT>(Par), Par.initStim);
+    Reset_Per_Task(Col.newstim, Num_Tasks<NT>(Par), 0);
+    Reset_Per_Task(Col.mean_work_alloc, Num_Tasks<NT>(Par), 0);
+    Reset_Per_Task(Col.noisy_threshold, Num_Tasks<NT>(Par), 0);
+    Reset_Per_Task(Col.wanted, task_set_words(Num_Tasks<NT>(Par)), 0);
 
     // go through all ants in the colony and initialize the
     // individual ants
-    for (unsigned int ant_i = 0; 
-            ant_i < Col.MyAnts.size(); 
-            ++ant_i)
+    Col.MyAnts.Resize(Par.N, Num_Tasks<NT>(Par));
+
+    for (int ant_i = 0; ant_i < Col.MyAnts.N; ++ant_i)
+    {
+        Init_Ants<NT>(Col.MyAnts, ant_i, Par);
+    }
+
+    if (Par.maxgen > 1)
+    {
+        Inherit_Workers(Col, Par, rng_r);
+    }
+    else 
     {
-        Init_Ants(Col.MyAnts[ant_i], Par, Col, ant_i, rng_r);
+        Col.MyAnts.learn.assign(Col.MyAnts.N, Par.initLearn);
+        Col.MyAnts.forget.assign(Col.MyAnts.N, Par.initForget);
     }
+
+    // set the initial efficiencies
+    UpdateEfficiency<NT>(Col.MyAnts, Par); 
 } // end of Init()
 //==================================================================================================================
 
 // given that one ant has started working update the colony stimulus
 // levels
-void UpdateStimPerAnt(Params & Par, Colony & anyCol, Ant & anyAnt, int task)
+template <unsigned int NT>
+void UpdateStimPerAnt(Params & Par, Colony<NT> & anyCol, int ant_i, int task)
 {
 #ifdef DEBUG
     cout << Par.N << endl;
@@ -877,15 +1507,17 @@ void UpdateStimPerAnt(Params & Par, Colony & anyCol, Ant & anyAnt, int task)
     cout <<anyCol.numacts_step[task]<< endl;
     cout << anyCol.stim[task] << endl;
 #endif
+
+    double alpha = anyCol.MyAnts.alpha[task * anyCol.MyAnts.N + ant_i];
     
     // increment total amount of work being done in the colony
     // by adding an alpha_i * 1 (here 1 is the new worker who works on
     // task 'task'.
-    anyCol.workfor[task] += anyAnt.alpha[task];    
+    anyCol.workfor[task] += alpha;    
 
     // update the stimulus accordingly (e.g., see eq. (3) in 
     // Bonabeau et al 1996
-    anyCol.stim[task] -= (anyAnt.alpha[task]/Par.N); 
+    anyCol.stim[task] -= (alpha/Par.N); 
        
     // set boundary of the stimulus at 0
     if (anyCol.stim[task] < 0)
@@ -895,40 +1527,54 @@ void UpdateStimPerAnt(Params & Par, Colony & anyCol, Ant & anyAnt, int task)
 }
 
 //====================================================================================================================
-void UpdateThresholds_And_Experience (Ant & anyAnt, Params & Par)
+// update thresholds, experience and efficiency of all workers in the 
+// colony, once all of them have chosen their task for this timestep:
+// - for the task the ant is currently working on, decrease the 
+// threshold and increase the experience points
+// - for all other tasks (all tasks when the ant is inactive), 
+// increase the threshold and decrease the experience points
+// - thresholds and experience points do not go below 0
+//
+// this is done a task at a time by the widest SIMD kernel 
+// the cpu supports (see worker_kernels.h)
+update_task_kernel worker_kernel = select_update_task_kernel();
+
+// and the version of the threshold comparison (see task_sets.h)
+wanted_tasks_kernel wanted_kernel = select_wanted_tasks_kernel();
+
+template <unsigned int NT>
+void UpdateThresholds_Experience_Efficiency(Workers & W, Params & Par)
 {
-    // update thresholds of all tasks
-    for (unsigned int task_i = 0; task_i < Par.tasks; ++task_i)
+    for (unsigned int task_i = 0; task_i < Num_Tasks<NT>(Par); ++task_i)
     {
-        // decrease thresholds and increase experience points
-        // when this is the task the ant is currently working on
-        if (anyAnt.curr_act == int(task_i))
-        {
-            anyAnt.threshold[task_i] -= anyAnt.learn;
-            anyAnt.experience_points[task_i] += Par.step_gain_exp;
-        }
-        else
-        {
-            // for all other tasks (which the ant is not currently 
-            // doing), increase thresholds and decrease experience points
-            anyAnt.threshold[task_i] += anyAnt.forget;
-            anyAnt.experience_points[task_i] -= Par.step_lose_exp;
-        }
+        double * threshold = &W.threshold[task_i * W.N];
+        double * experience_points = &W.experience_points[task_i * W.N];
+        double * alpha = &W.alpha[task_i * W.N];
 
-        // note that if ant is inactive she will increase her thresholds
-        // and decrease experience points for all tasks
+        efficiency_lookup eff = Efficiency_Lookup(Par, task_i);
 
-        
-        // prevent thresholds and experience points from taking negative values
-        if (anyAnt.threshold[task_i] < 0)
-        {
-            anyAnt.threshold[task_i] = 0;
-        }
+#ifdef DEBUG
+        // validate the kernel against the scalar version
+        vector<double> check_threshold(threshold, threshold + W.N);
+        vector<double> check_experience(experience_points, experience_points + W.N);
+        vector<double> check_alpha(W.N);
+
+        update_task_scalar(W.N, task_i, &W.curr_act[0], 
+                &W.learn[0], &W.forget[0], 
+                &check_threshold[0], &check_experience[0], &check_alpha[0],
+                Par.step_gain_exp, Par.step_lose_exp, eff);
+#endif
 
-        if (anyAnt.experience_points[task_i] < 0)
-        {
-            anyAnt.experience_points[task_i] = 0;
-        }
+        worker_kernel(W.N, task_i, &W.curr_act[0], 
+                &W.learn[0], &W.forget[0],
+                threshold, experience_points, alpha,
+                Par.step_gain_exp, Par.step_lose_exp, eff);
+
+#ifdef DEBUG
+        assert(memcmp(&check_threshold[0], threshold, W.N * sizeof(double)) == 0);
+        assert(memcmp(&check_experience[0], experience_points, W.N * sizeof(double)) == 0);
+        assert(memcmp(&check_alpha[0], alpha, W.N * sizeof(double)) == 0);
+#endif
     }
 }   
 //========================================================================================================================
@@ -937,20 +1583,94 @@ void UpdateThresholds_And_Experience (Ant & anyAnt, Params & Par)
 // 1. ant is currently active
 // 2. last act wasn't inactivity
 // 3. last act was different from current act
-void UpdateSwitches(Ant & anyAnt, Params & Par)
+template <unsigned int NT>
+void UpdateSwitches(Workers & W, int ant_i, Params & Par)
 {
-    if (anyAnt.curr_act < int(Par.tasks) && 
-            anyAnt.last_act != 7 && 
-            anyAnt.last_act != anyAnt.curr_act)
+    if (W.curr_act[ant_i] < int(Num_Tasks<NT>(Par)) && 
+            W.last_act[ant_i] != NO_ACT && 
+            W.last_act[ant_i] != W.curr_act[ant_i])
     {
-        ++anyAnt.switches;
+        ++W.switches[ant_i];
     }
 }
 //end UpdateSwitches
 //=========================================================================================================================
 
+// keep the colony's running sums of switches and workperiods
+// up to date after ant ant_i changed from old_switches and 
+// old_workperiods to her current values. Like Calc_D, only
+// ants with more than one workperiod are counted
+template <unsigned int NT>
+void Update_Spec_Sums(Colony<NT> & Col, 
+        int ant_i,
+        int old_switches, 
+        int old_workperiods)
+{
+    Workers & W = Col.MyAnts;
+
+    if (old_workperiods > 1)
+    {
+        --Col.spec_active;
+        Col.sum_switches -= old_switches;
+        Col.sumsquares_switches -= old_switches * old_switches;
+        Col.sum_workperiods -= old_workperiods;
+        Col.sumsquares_workperiods -= old_workperiods * old_workperiods;
+    }
+
+    if (W.workperiods[ant_i] > 1)
+    {
+        ++Col.spec_active;
+        Col.sum_switches += W.switches[ant_i];
+        Col.sumsquares_switches += W.switches[ant_i] * W.switches[ant_i];
+        Col.sum_workperiods += W.workperiods[ant_i];
+        Col.sumsquares_workperiods += 
+            W.workperiods[ant_i] * W.workperiods[ant_i];
+    }
+}
+//=========================================================================================================================
+
+// number of working ants that do not quit before the next one that
+// does: as each quits with probability p, it is geometrically
+// distributed (the number of failures before the first success)
+long Quit_Skip(Params & Par, philox_buffer & rng_r)
+{
+    return geometric_skip(Par.p, philox_buffer_uniform_pos(rng_r));
+}
+
+// whether a working ant quits her task, which she does with
+// probability p. In the QUIT_BATCHED regime this does not take a 
+// random number per working ant: Update_Ants draws how many working 
+// ants are skipped before the first one that quits, in the order 
+// in which the ants are visited, and after each ant that quits 
+// how many are skipped before the next one. This gives the same 
+// distribution of quitting ants, with a random number per quitting ant
+template <unsigned int NT, unsigned int R>
+bool Quits(Colony<NT> & anyCol, Params & Par, philox_buffer & rng_r)
+{
+    if (R & QUIT_ALWAYS)
+    {
+        return true;
+    }
+
+    if (R & QUIT_BATCHED)
+    {
+        if (anyCol.quit_skip > 0)
+        {
+            --anyCol.quit_skip;
+            return false;
+        }
+
+        anyCol.quit_skip = Quit_Skip(Par, rng_r);
+        return true;
+    }
+
+    // draw random number to compare with quitting probability
+    return philox_buffer_uniform(rng_r) <= Par.p;
+}
+
 // calculate whether ant is quitting a task
-void QuitTask(Colony & anyCol, Ant & anyAnt, int job, Params & Par, gsl_rng *rng_r)
+template <unsigned int NT, unsigned int R>
+void QuitTask(Colony<NT> & anyCol, int ant_i, int job, Params & Par, philox_buffer & rng_r)
 {
 #ifdef DEBUG
     cout << "Quitting tasks" << endl;
@@ -958,20 +1678,19 @@ void QuitTask(Colony & anyCol, Ant & anyAnt, int job, Params & Par, gsl_rng *rng
 
 #endif
 
-    // draw random number to compare with quitting probability
-    double q = gsl_rng_uniform(rng_r);
+    Workers & W = anyCol.MyAnts;
 
     // evaluate chance to quit
-    if (q <= Par.p)
+    if (Quits<NT, R>(anyCol, Par, rng_r))
     {
-        anyAnt.want_task[anyAnt.curr_act] = false;
+        task_set_remove(&W.want_task[ant_i * W.want_words], W.curr_act[ant_i]);
 
         // set time worked to zero, 
         // she may choose the same or another task next
-        anyAnt.count_time = 0;
+        W.count_time[ant_i] = 0;
         
         // set her current task to something beyond the current task options
-        anyAnt.curr_act = Par.tasks;
+        W.curr_act[ant_i] = Num_Tasks<NT>(Par);
     }
     else // ant does not quit
     {
@@ -980,22 +1699,24 @@ void QuitTask(Colony & anyCol, Ant & anyAnt, int job, Params & Par, gsl_rng *rng
 #ifndef SIMULTANEOUS_UPDATE  
 
         // update stimulus levels now that new ant has joined workforce
-        UpdateStimPerAnt(Par, anyCol, anyAnt, job);
+        UpdateStimPerAnt(Par, anyCol, ant_i, job);
 #endif
     }
 
 }
 
 //------------------------------------------------------------------------------
-void DoTask(Params Par, Colony & anyCol, Ant & anyAnt,int job)
+template <unsigned int NT>
+void DoTask(Params & Par, Colony<NT> & anyCol, int ant_i, int job)
 {
+         Workers & W = anyCol.MyAnts;
 
-         anyAnt.curr_act = job; 
-         anyAnt.workperiods +=1; 
-         anyAnt.countacts[job] +=1;
+         W.curr_act[ant_i] = job; 
+         W.workperiods[ant_i] +=1; 
+         W.countacts[job * W.N + ant_i] +=1;
         
 #ifndef SIMULTANEOUS_UPDATE 
-         UpdateStimPerAnt(Par, anyCol, anyAnt, job);
+         UpdateStimPerAnt(Par, anyCol, ant_i, job);
 #endif
 }
 //end DoTask
@@ -1005,92 +1726,102 @@ void DoTask(Params Par, Colony & anyCol, Ant & anyAnt,int job)
 // several outcomes: ant may prefer one or multiple tasks. In the latter
 // case, one of those tasks is selected as the preferred task
 // she may also want to prefer no task yet
-void WantTask (Params Par, 
-        Colony & anyCol, 
-        Ant & focalAnt,
-        gsl_rng * rng_r
+template <unsigned int NT, unsigned int R>
+void WantTask (Params & Par, 
+        Colony<NT> & anyCol, 
+        int ant_i,
+        philox_buffer & rng_r
         )
 {
-    // make a list of all the task that this ants wants to do
-    // and reserve space for it
-    vector<int>wanted_task_ids;
-    wanted_task_ids.reserve(Par.tasks); 
+    Workers & W = anyCol.MyAnts;
 
-    // variable to store the focal ant's threshold value + noise for a task
-    double t_noise;
-
-    // loop through all tasks and calculate thresholds
-    for (unsigned int task_i = 0; task_i < Par.tasks; ++task_i)
+    // the ant's thresholds + random noise for all tasks 
+    // (a negative threshold + noise would be set to 0, but this
+    // makes no difference for the comparison below)
+    for (unsigned int task_i = 0; task_i < Num_Tasks<NT>(Par); ++task_i)
     {
-        // calculate threshold + random noise
-        t_noise = focalAnt.threshold[task_i] + gsl_ran_gaussian(rng_r, Par.threshold_noise);
-
-        // threshold cannot be negative
-        if (t_noise < 0)
-        {
-            t_noise = 0;
-        }
-
-        // ants want to work on tasks for which 
-        // - their threshold exceeds the threshold + noise
-        // - the stimulus level is nonzero (i.e., work needs to be done)
-        if (anyCol.stim[task_i] >= t_noise && anyCol.stim[task_i] > 0) 
-        {
-            // store the wanted task
-            wanted_task_ids.push_back(task_i);  
-        } 
-        else // ok ant does not want this task
+        anyCol.noisy_threshold[task_i] = W.threshold[task_i * W.N + ant_i];
+        
+        if (!(R & NO_NOISE))
         {
-            // if ant's threshold not high enough, then quit with wanting task
-            focalAnt.want_task[task_i] = false;
+            anyCol.noisy_threshold[task_i] += philox_buffer_gaussian(rng_r, Par.threshold_noise);
         }
     }
 
+    // ants want to work on tasks for which 
+    // - their threshold exceeds the threshold + noise
+    // - the stimulus level is nonzero (i.e., work needs to be done)
+    uint64_t * wanted = &anyCol.wanted[0];
+
+#ifdef DEBUG
+    // validate the kernel against the scalar version
+    typename Per_Task < uint64_t, (NT + 63) / 64 >::type check_wanted;
+    Reset_Per_Task(check_wanted, task_set_words(Num_Tasks<NT>(Par)), 0);
+    wanted_tasks_scalar(Num_Tasks<NT>(Par), &anyCol.stim[0], 
+            &anyCol.noisy_threshold[0], &check_wanted[0]);
+#endif
+
+    wanted_kernel(Num_Tasks<NT>(Par), &anyCol.stim[0], 
+            &anyCol.noisy_threshold[0], wanted);
+
+#ifdef DEBUG
+    assert(memcmp(&check_wanted[0], wanted, 
+                W.want_words * sizeof(uint64_t)) == 0);
+#endif
+
+    // TaskChoice only lets ants without a wanted task choose
+    uint64_t * want_task = &W.want_task[ant_i * W.want_words];
+    assert(task_set_count(want_task, W.want_words) == 0);
+
+    unsigned int num_wanted = task_set_count(wanted, W.want_words);
+
     // if more than one task is above threshold, select a random task
     // that ant wants to perform
-    if (wanted_task_ids.size() > 1)
+    if (num_wanted > 1)
     {
-        int job = gsl_rng_uniform_int(rng_r, wanted_task_ids.size());
-        focalAnt.want_task[wanted_task_ids[job]] = true;
+        int job = philox_buffer_uniform_int(rng_r, num_wanted);
+        task_set_add(want_task, task_set_select(wanted, job));
     }
-    else if (!wanted_task_ids.empty())
+    else if (num_wanted == 1)
     {
-        assert(wanted_task_ids[0] >= 0);
-        assert(wanted_task_ids[0] < int(Par.tasks));
-
-        focalAnt.want_task[wanted_task_ids[0]] = true;
+        task_set_add(want_task, task_set_first(wanted, W.want_words));
     }
 }
 //end WantTask
 //-----------------------------------------------------------------------------
 
 // evaluate whether ant should switch tasks
+template <unsigned int NT, unsigned int R>
 void EvalTaskSwitch(Params & Par, 
-        Colony & anyCol, 
-        Ant & anyAnt,
+        Colony<NT> & anyCol, 
+        int ant_i,
         int myjob, 
-        gsl_rng *rng_r)
+        philox_buffer & rng_r)
 {
+    Workers & W = anyCol.MyAnts;
+
     // if it was doing this job previously 
     // or it did not do anything before
     // just perform the task
-    if (myjob == anyAnt.last_act || anyAnt.last_act == 7) 
+    if (myjob == W.last_act[ant_i] || W.last_act[ant_i] == NO_ACT) 
     {
-        DoTask(Par, anyCol, anyAnt, myjob);
+        DoTask(Par, anyCol, ant_i, myjob);
     }
     else  // ok, ant <is doing a different task than dei
     {
-        // with a certain probability 
-        if (Par.p_wait >= gsl_rng_uniform(rng_r) 
-                && anyAnt.count_time < Par.timecost)    
+        // with a certain probability (no random number is needed
+        // if ants always wait or never have to wait)
+        if (!(R & WAIT_NEVER) 
+                && ((R & WAIT_ALWAYS) || Par.p_wait >= philox_buffer_uniform(rng_r))
+                && W.count_time[ant_i] < Par.timecost)    
         {
             //cout << "Ant wants to change task!" << endl;    
-            anyAnt.curr_act=2; // stays idle for as long as count_time<timecost    
-            ++anyAnt.count_time;
+            W.curr_act[ant_i] = Num_Tasks<NT>(Par); // stays idle for as long as count_time<timecost    
+            ++W.count_time[ant_i];
         }
         else
         {
-            DoTask(Par, anyCol, anyAnt, myjob);
+            DoTask(Par, anyCol, ant_i, myjob);
         }
     }
 }
@@ -1098,139 +1829,148 @@ void EvalTaskSwitch(Params & Par,
 //-------------------------------------------------------------------------------
 
 // act of choosing a task
+template <unsigned int NT, unsigned int R>
 void TaskChoice(
         Params & Par, // parameter object
-        Colony & anyCol, // current colony
-        Ant & focalAnt,// the ant in question
-        gsl_rng *rng_r) 
+        Colony<NT> & anyCol, // current colony
+        int ant_i,// the ant in question
+        philox_buffer & rng_r) 
 { 
+    Workers & W = anyCol.MyAnts;
+
 #ifdef DEBUG
 
     // debugging only: assert that ants do not want to do
     // multiple tasks at the same time
-    bool wants_task = false;
-    for (int task_i = 0; task_i < Par.tasks; ++task_i)
+    if (task_set_count(&W.want_task[ant_i * W.want_words], W.want_words) > 1)
     {
-        // ants wants to perform task i
-        if (focalAnt.want_task[task_i])
-        {
-            // if it previously already did not already prefer a task
-            if (!wants_task)
-            {
-                wants_task = true;
-            }
-            else
-            {
-                cout << "error: ant wants multiple tasks simultaneously";
-                exit(1);
-            }
-        }
+        cout << "error: ant wants multiple tasks simultaneously";
+        exit(1);
     }
 #endif
 
      // find out if ant wants to perform a task
-    for (unsigned int task_i = 0; task_i < Par.tasks; ++task_i)
-    {
-        // yes, ant wants to perform task so let's do it
-        if (focalAnt.want_task[task_i])
-        {
-            EvalTaskSwitch(Par, anyCol, focalAnt, task_i, rng_r); 
-            return;
-        }
-    }
+    int task_i = task_set_first(&W.want_task[ant_i * W.want_words], W.want_words);
 
     // ant does not want to perform a task
+    if (task_i < 0)
+    {
+        // make ant want task
+        WantTask<NT, R>(Par, anyCol, ant_i, rng_r);
 
-    // make ant want task
-    WantTask(Par, anyCol, focalAnt, rng_r);
+         // find out if ant now wants to perform a task
+        task_i = task_set_first(&W.want_task[ant_i * W.want_words], W.want_words);
+    }
 
-     // find out if ant now wants to perform a task
-    for (unsigned int task_i = 0; task_i < Par.tasks; ++task_i)
+    // yes, ant wants to perform task so let's do it
+    if (task_i >= 0)
     {
-        // yes, ant wants to perform task so let's do it
-        if (focalAnt.want_task[task_i])
-        {
-            EvalTaskSwitch(Par, anyCol, focalAnt, task_i, rng_r); 
-            return;
-        }
+        EvalTaskSwitch<NT, R>(Par, anyCol, ant_i, task_i, rng_r); 
     }
 } // end of TaskChoice()
 //===============================================================================================
 
 // if ant is working, see whether it might quit
 // if ant is not working, see whether it might start a task
-void Update_Ants(Colony & Col, Params & Par, gsl_rng *rng_r)
+template <unsigned int NT, unsigned int R>
+void Update_Ants(Colony<NT> & Col, Params & Par, philox_buffer & rng_r, philox_buffer & rng_order)
 {
+    Workers & W = Col.MyAnts;
+
     // go through all tasks and reset their stats to 0
-    for (unsigned int task_i = 0; task_i < Par.tasks; ++task_i)
+    for (unsigned int task_i = 0; task_i < Num_Tasks<NT>(Par); ++task_i)
     {
          Col.workfor[task_i] = 0; 
          Col.numacts_step[task_i] = 0;
     }
 
-    // randomize order of ants 
-    random_shuffle(Col.MyAnts.begin(), Col.MyAnts.end());
+    // randomize order of ants (Fisher-Yates shuffle)
+    for (int order_i = W.N - 1; order_i > 0; --order_i)
+    {
+        swap(W.order[order_i], 
+                W.order[philox_buffer_uniform_int(rng_order, order_i + 1)]);
+    }
+
+    // the working ants to skip before the first one that quits
+    if (R & QUIT_BATCHED)
+    {
+        Col.quit_skip = Quit_Skip(Par, rng_r);
+    }
         
     // go through all ants and evaluate what they are doing/going to do
-    for (unsigned int ant_i = 0; ant_i < Col.MyAnts.size(); ++ant_i)  
+    for (int order_i = 0; order_i < W.N; ++order_i)  
     {
+        int ant_i = W.order[order_i];
+
+        // remember current counts to update the specialization sums
+        int old_switches = W.switches[ant_i];
+        int old_workperiods = W.workperiods[ant_i];
+
         // check if ant is doing one of the tasks
-        if (Col.MyAnts[ant_i].curr_act < int(Par.tasks))
+        if (W.curr_act[ant_i] < int(Num_Tasks<NT>(Par)))
         {
             // yes, ant is busy, hence record last act
-            Col.MyAnts[ant_i].last_act = Col.MyAnts[ant_i].curr_act; 
+            W.last_act[ant_i] = W.curr_act[ant_i]; 
 
             // evaluate whether ant will quit task
-            QuitTask(Col, Col.MyAnts[ant_i], Col.MyAnts[ant_i].curr_act, Par, rng_r); 
+            QuitTask<NT, R>(Col, ant_i, W.curr_act[ant_i], Par, rng_r); 
         }
 
         // ant currently inactive, let it choose a task
         // (note that this can include an ant
         // who quit in the previous statement)
-        if (Col.MyAnts[ant_i].curr_act >= int(Par.tasks))
+        if (W.curr_act[ant_i] >= int(Num_Tasks<NT>(Par)))
         {
-            TaskChoice(Par, Col, Col.MyAnts[ant_i], rng_r);
+            TaskChoice<NT, R>(Par, Col, ant_i, rng_r);
         }
             
         //update number of switches after choosing tasks
-        UpdateSwitches(Col.MyAnts[ant_i], Par);
+        UpdateSwitches<NT>(W, ant_i, Par);
 
-        // update the thresholds and experience levels
-        UpdateThresholds_And_Experience(Col.MyAnts[ant_i], Par);
+        if (W.switches[ant_i] != old_switches || 
+                W.workperiods[ant_i] != old_workperiods)
+        {
+            Update_Spec_Sums(Col, ant_i, old_switches, old_workperiods);
+        }
+    } // end for W.order
 
-        // update the ant's efficiency
-        UpdateEfficiency(Col.MyAnts[ant_i], Par);
-    } // end for Col.MyAnts.
+    // update the thresholds, experience levels and efficiencies.
+    // an ant's thresholds and efficiencies only affect her own 
+    // task choice, so this can wait until all ants have chosen
+    UpdateThresholds_Experience_Efficiency<NT>(W, Par);
           
 }  // end of Update_Ants()
 //------------------------------------------------------------------------------
 
+template <unsigned int NT>
 void Update_Col_Data(
         int step,  // current timestep
-        Colony & Col, // the metapopulation
+        Colony<NT> & Col, // the metapopulation
         Params & Par // the parameters
         )
 {
+    Workers & W = Col.MyAnts;
+
     Col.inactive = 0;
 
-    for (unsigned int ant_i = 0; ant_i < Col.MyAnts.size(); ++ant_i)
+    for (int ant_i = 0; ant_i < W.N; ++ant_i)
     {
         // check whether ant is active
-        if (Col.MyAnts[ant_i].curr_act < int(Par.tasks))
+        if (W.curr_act[ant_i] < int(Num_Tasks<NT>(Par)))
         {
             // if active update act count
-            Col.numacts_step[Col.MyAnts[ant_i].curr_act] += 1; 
+            Col.numacts_step[W.curr_act[ant_i]] += 1; 
         }
         else // ant inactive, count it
         {
             ++Col.inactive;
         }
         
-        Col.inactive /= Col.MyAnts.size(); // proportion inactive workers 
+        Col.inactive /= W.N; // proportion inactive workers 
     }
     
     // update counts of the total acts performed in the colony
-    for (unsigned int task_i = 0; task_i < Par.tasks; ++task_i)
+    for (unsigned int task_i = 0; task_i < Num_Tasks<NT>(Par); ++task_i)
     {
         Col.numacts_total[task_i] += Col.numacts_step[task_i]; 
     
@@ -1247,9 +1987,10 @@ void Update_Col_Data(
 //===================================================================================================
 //
 // update the stimulus levels
-void Update_Stim(Colony &Col, Params & Par)   
+template <unsigned int NT>
+void Update_Stim(Colony<NT> &Col, Params & Par)   
 {
-    for (unsigned int task = 0; task < Par.tasks; ++task)
+    for (unsigned int task = 0; task < Num_Tasks<NT>(Par); ++task)
     {
 
 #ifdef SIMULTANEOUS_UPDATE
@@ -1274,13 +2015,15 @@ void Update_Stim(Colony &Col, Params & Par)
 //==============================================================================================
 
 // calculate specialization value
-void Calc_D(Colony & Col, Params & Par)
+// 
+// the switch and workperiod statistics follow from the running
+// sums kept by Update_Ants, so that only D and Dx need a pass
+// over the workers. Called once at the end of a generation
+// (or every timestep when CALC_D_PERSTEP is defined)
+template <unsigned int NT>
+void Calc_D(Colony<NT> & Col, Params & Par)
 {
-    Col.mean_D=0;
-    Col.mean_Dx=0; 
-
-    Col.mean_switches=0; 
-    Col.mean_workperiods=0; 
+    Workers & W = Col.MyAnts;
 
     // calculate D = qbar / sum(p_i^2, i= 0, 1, 2, ... n_tasks) - 1
     // see eq. (5) in Duarte et al 2012 Behav Ecol Sociobiol
@@ -1288,7 +2031,8 @@ void Calc_D(Colony & Col, Params & Par)
     
     // we need to calculate the proportion of acts for task i
     // as these are the p_i values in eq (5) of Duarte et al.
-    double prop_work[Par.tasks];
+    typename Per_Task < double, NT >::type prop_work;
+    Reset_Per_Task(prop_work, Num_Tasks<NT>(Par), 0);
 
     // with these p_i values we can then calculate the total
     // denominator of D
@@ -1298,13 +2042,13 @@ void Calc_D(Colony & Col, Params & Par)
     double total_work = 0;
 
     // sum total work
-    for (unsigned int task_i = 0; task_i < Par.tasks; ++task_i)
+    for (unsigned int task_i = 0; task_i < Num_Tasks<NT>(Par); ++task_i)
     {
         total_work += Col.numacts_total[task_i];
     }
 
     // then it is easy to calculate proportions
-    for (unsigned int task_i = 0; task_i < Par.tasks; ++task_i)
+    for (unsigned int task_i = 0; task_i < Num_Tasks<NT>(Par); ++task_i)
     {
         prop_work[task_i] = Col.numacts_total[task_i] / total_work;
 
@@ -1318,12 +2062,8 @@ void Calc_D(Colony & Col, Params & Par)
     double sumDx =0; 
     double sumsquares_Dx =0;
 
-    // we also want to calculate variances, which are given by 
-    // Var[x] = E[x^2] - E[x]^2
-    double sumsquares_switches=0; 
-    double sumsquares_workperiods=0;
-
-    double activ=0;
+    // number of ants that worked more than once
+    double activ = Col.spec_active;
     
     // calculate the probability that an individual ant
     // switches between one timestep and the next
@@ -1331,66 +2071,54 @@ void Calc_D(Colony & Col, Params & Par)
    
 
     // go through all ants and calculate specialization stats
-    for (unsigned int ant_i = 0; ant_i < Col.MyAnts.size(); ++ant_i)
+    for (int ant_i = 0; ant_i < W.N; ++ant_i)
     {
-        assert(Col.MyAnts[ant_i].workperiods <= Par.maxtime);
-
-        // set switching prob to 0
-        switch_prob = 0;
+        assert(W.workperiods[ant_i] <= Par.maxtime);
 
-        if (Col.MyAnts[ant_i].workperiods > 1)
+        if (W.workperiods[ant_i] > 1)
         {
-            Col.mean_switches += Col.MyAnts[ant_i].switches;
-            Col.mean_workperiods += Col.MyAnts[ant_i].workperiods;
-
-            // calculate sum of squares for workperiods
-            sumsquares_workperiods += 
-                Col.MyAnts[ant_i].workperiods * Col.MyAnts[ant_i].workperiods;
-
-            sumsquares_switches += 
-                Col.MyAnts[ant_i].switches * Col.MyAnts[ant_i].switches;
-
             // switching prob between one timestep and the next
             // is total number of switches divided by total possible
             // moments to switch (which is total number of workperiods - 1)
             // -1 as you cannot switch anymore during the last work period
-            switch_prob = (double) Col.MyAnts[ant_i].switches / 
-                (Col.MyAnts[ant_i].workperiods - 1.0);
+            switch_prob = (double) W.switches[ant_i] / 
+                (W.workperiods[ant_i] - 1.0);
 
             // D = qbar (see eq (5) in Duarte et al) is then given by
             // qbar = 1.0 - switch_prob
 
             // however, when we want to scale between -1 and 1,
             // we do:
-            Col.MyAnts[ant_i].D = 1.0 - 2.0 * switch_prob;
+            W.D[ant_i] = 1.0 - 2.0 * switch_prob;
 
-            sumsquares_D += Col.MyAnts[ant_i].D * Col.MyAnts[ant_i].D;
+            sumsquares_D += W.D[ant_i] * W.D[ant_i];
 
             // or in case we want to correct for the fact that ants may
             // remain at the same task due to randomness, we have to divide
             // by D_denominator. We have to substract 1.0 to scale between
             // -1 and 1
-            Col.MyAnts[ant_i].Dx = (1.0 - switch_prob) / D_denominator - 1.0;
+            W.Dx[ant_i] = (1.0 - switch_prob) / D_denominator - 1.0;
             
-            sumsquares_Dx += Col.MyAnts[ant_i].Dx * Col.MyAnts[ant_i].Dx;
+            sumsquares_Dx += W.Dx[ant_i] * W.Dx[ant_i];
 
-            sumD += Col.MyAnts[ant_i].D;
-            activ += 1.0;
-            sumDx += Col.MyAnts[ant_i].Dx;
+            sumD += W.D[ant_i];
+            sumDx += W.Dx[ant_i];
         }
     }
 
-    Col.mean_switches /= activ;
+    // we also want to calculate variances, which are given by 
+    // Var[x] = E[x^2] - E[x]^2
+    Col.mean_switches = Col.sum_switches / activ;
 
-    Col.mean_workperiods = Col.mean_workperiods/Col.MyAnts.size();
+    Col.mean_workperiods = (double) Col.sum_workperiods / W.N;
     
     Col.mean_D = sumD/activ;
     Col.mean_Dx = sumDx/activ;
 
-    Col.var_switches = sumsquares_switches / activ 
+    Col.var_switches = Col.sumsquares_switches / activ 
         - Col.mean_switches * Col.mean_switches;
 
-    Col.var_workperiods = sumsquares_workperiods / activ 
+    Col.var_workperiods = Col.sumsquares_workperiods / activ 
         - Col.mean_workperiods * Col.mean_workperiods;
 
     Col.var_D = sumsquares_D / activ - Col.mean_D * Col.mean_D;
@@ -1400,12 +2128,15 @@ void Calc_D(Colony & Col, Params & Par)
 //=======================================================================================================================
 
 // determine fitness
-void Calc_Abs_Fitness(Colony & Col, Params & Par)
+template <unsigned int NT>
+void Calc_Abs_Fitness(Colony<NT> & Col, Params & Par)
 {
+    Workers & W = Col.MyAnts;
+
     Col.fitness = Col.fitness_work[0];
     Col.mean_work_alloc[0] /= Par.maxtime - Par.tau;
 
-    for (unsigned int task_i = 1; task_i < Par.tasks; ++task_i)
+    for (unsigned int task_i = 1; task_i < Num_Tasks<NT>(Par); ++task_i)
     {
         // multiplicative fitness
         Col.fitness *= Col.fitness_work[task_i];
@@ -1420,9 +2151,9 @@ void Calc_Abs_Fitness(Colony & Col, Params & Par)
     Col.idle = 0;
 
     // calculate the number of idle ants 
-    for (unsigned int j = 0; j < Col.MyAnts.size(); ++j)
+    for (int j = 0; j < W.N; ++j)
     {
-        if (Col.MyAnts[j].workperiods == 0)
+        if (W.workperiods[j] == 0)
         {
             Col.idle +=1;
         }
@@ -1430,6 +2161,30 @@ void Calc_Abs_Fitness(Colony & Col, Params & Par)
 
 }
 
+// hand back the results of a simulated colony that are needed
+// for reproduction and output
+template <unsigned int NT>
+void Store_Colony_Summary(Colony<NT> & Col, ColonySummary & Summary)
+{
+    Summary.stim.assign(Col.stim.begin(), Col.stim.end());
+    Summary.numacts_step.assign(Col.numacts_step.begin(), Col.numacts_step.end());
+    Summary.idle = Col.idle;
+    Summary.inactive = Col.inactive;
+    Summary.fitness_work.assign(Col.fitness_work.begin(), Col.fitness_work.end());
+    Summary.fitness = Col.fitness;
+    Summary.rel_fit = 0;
+    Summary.cum_fit = 0;
+    Summary.mean_work_alloc.assign(Col.mean_work_alloc.begin(), Col.mean_work_alloc.end());
+    Summary.mean_D = Col.mean_D;
+    Summary.var_D = Col.var_D;
+    Summary.mean_Dx = Col.mean_Dx;
+    Summary.var_Dx = Col.var_Dx;
+    Summary.mean_switches = Col.mean_switches;
+    Summary.var_switches = Col.var_switches;
+    Summary.mean_workperiods = Col.mean_workperiods;
+    Summary.var_workperiods = Col.var_workperiods;
+}
+
 // calculate relative fitness of all colonies
 void Calc_Rel_Fitness(Population &Pop, Params &Par)
 {
@@ -1447,100 +2202,84 @@ void Calc_Rel_Fitness(Population &Pop, Params &Par)
 //-------------------------------------------------------------------------------
 //-------------------------------------------------------------------------------
 
+// order colonies by their cumulative fitness, for the 
+// binary search in Make_Sexuals
+bool Cum_Fit_Below(const ColonySummary & Col, double value)
+{
+    return Col.cum_fit < value;
+}
+
 // generate reproducing individuals
-void Make_Sexuals(Population & Pop, Params & Par)
+//
+// each sexual samples its parental colony from the cumulative 
+// fitness distribution and inherits from that colony's founders. 
+// Every sexual has its own random number stream, so that sexuals
+// can be made in parallel and the result does not depend on the 
+// number of threads
+void Make_Sexuals(Population & Pop, Params & Par, int generation, int num_threads)
 {
     mySexuals.resize(2 * Par.Col); // number of sexuals needed
-    parentCol.resize(mySexuals.size());
-
-    // make a list of doubles that contain all the random deviates
-    // we need to sample in the cumulative fitness distribution
-    // each random deviate stands for the sampling of one sexual individual
-    // from the fitness distribution of all colonies
-    vector < double > cumul_dist_samples(mySexuals.size(), 0);
 
-    // fill the list of deviates
-    for (unsigned int sample_i = 0; sample_i < mySexuals.size(); ++sample_i)
+# pragma omp parallel for num_threads(num_threads)
+    for (unsigned int sexual_i = 0; sexual_i < mySexuals.size(); ++sexual_i)
     {
-        // store random values of the cumulative distribution in the array
-        cumul_dist_samples[sample_i] = gsl_rng_uniform(rng_global) * sum_fitness;
-    }
-
-    // now sort the list of random deviates
-    // from low to high.
-    sort(cumul_dist_samples.begin(), cumul_dist_samples.end());
+        philox_rng rng_r;
+        philox_rng_set(rng_r, Par.seed, RNG_SEXUALS, generation, sexual_i);
 
-    unsigned int cumul_counter = 0;
-
-    unsigned int new_sexual_ind = 0;
-
-    // associate deviates with population
-    for (unsigned int col_i = 0; col_i < Pop.size(); ++col_i)
-    {
-        // note that there 2*Ncol deviates to be found in the cumulative
-        // distribution, meaning we'd hit each colony's cumulative fitness 
-        // on average multiple times
-        //
-        // now see whether there are deviates lower than this value
-        for (; cumul_counter < mySexuals.size(); ++cumul_counter) 
-        {
-//            cout << "colony: " << col_i 
-//                << " cumul_sexual_counter: " << cumul_counter 
-//                << " cumul fit: " << Pop[col_i].cum_fit 
-//                << " sum fit: " << sum_fitness 
-//                << " deviate: " << cumul_dist_samples[cumul_counter] << endl;
-
-            // yes, deviate lower. make a new sexual individual from this colony
-            if (cumul_dist_samples[cumul_counter] <= Pop[col_i].cum_fit)
-            {
-                assert(new_sexual_ind < mySexuals.size());
+        // random value of the cumulative distribution
+        double cumul_dist_sample = philox_rng_uniform(rng_r) * sum_fitness;
 
-                // inherit loci from the colony's founders 
-                Inherit(mySexuals[new_sexual_ind], 
-                        Pop[parentCol[col_i]].queen, 
-                        Pop[parentCol[col_i]].male, 
-                        Par,
-                        rng_global);
+        // the first colony whose cumulative fitness reaches the sample
+        unsigned int col_i = lower_bound(Pop.begin(), Pop.end(), 
+                cumul_dist_sample, Cum_Fit_Below) - Pop.begin();
 
-                ++new_sexual_ind;
-            }
-            else// deviate too large? Move on to the next element in cumul dist
-            {
-                break;
-            }
-        } // end for cumul_counter
-    } // end for col_i
+        assert(col_i < Pop.size());
 
-    assert(new_sexual_ind == mySexuals.size());
+        // inherit loci from the colony's founders 
+        Inherit(mySexuals[sexual_i].learn, 
+                mySexuals[sexual_i].forget, 
+                Pop[col_i].queen, 
+                Pop[col_i].male, 
+                Par,
+                rng_r);
+    }
 
 } // end of MakeSexuals
 //-------------------------------------------------------------------------------------------
-void Make_Colonies(Population &Pop)
+// pair the sexuals at random into the founders of the new colonies
+//
+// this is a partial Fisher-Yates shuffle: a sampled sexual is swapped 
+// to the end of the part of mySexuals that is still available, 
+// so that nothing needs to be erased
+void Make_Colonies(Population &Pop, philox_rng & rng_r)
 {
     int mother, father;
 
+    // sexuals in [0, available) have not been used yet
+    unsigned int available = mySexuals.size();
+
     for (unsigned int col = 0; col < Pop.size(); ++col)
     {
-        assert(mySexuals.size() >= 2);
+        assert(available >= 2);
 
         // sample random mother
-        mother = gsl_rng_uniform_int(rng_global, mySexuals.size());
+        mother = philox_rng_uniform_int(rng_r, available);
 
-        // make this mother the queen of Colony col
-        Pop[col].queen = mySexuals[mother];
+        // remove this individual from the available sexuals
+        --available;
+        swap(mySexuals[mother], mySexuals[available]);
 
-        // remove this individual from stack of sexuals
-        mySexuals.erase(mySexuals.begin() + mother);
+        // make this mother the queen of Colony col
+        Pop[col].queen = mySexuals[available];
 
         // sample random father
-        father = gsl_rng_uniform_int(rng_global, mySexuals.size());
-
-        // make this father the male of Colony col
-        Pop[col].male = mySexuals[father];
+        father = philox_rng_uniform_int(rng_r, available);
 
-        // remove break
-        mySexuals.erase(mySexuals.begin() + father);
+        --available;
+        swap(mySexuals[father], mySexuals[available]);
 
+        // make this father the male of Colony col
+        Pop[col].male = mySexuals[available];
     } 
 } // end Make_Colonies()
 //-----------------------------------------------------------------------------------------------------
@@ -1551,7 +2290,8 @@ void Make_Colonies(Population &Pop)
 void Write_Last_Generation(
         Population &Pop, 
         int generation,
-        Params & Par
+        Params & Par,
+        bool last_generation
         ) 
 {
     // open output file
@@ -1559,8 +2299,7 @@ void Write_Last_Generation(
 
     // only plot the last generation once every 10 generations
     // or at the last generation of the simulation
-    if (generation % 10 == 0 ||
-            generation - simstart_generation == Par.maxgen - 1)
+    if (generation % 10 == 0 || last_generation)
     {
         last_gen_stream.open("lastgen.txt");
 
@@ -1585,6 +2324,66 @@ void Write_Last_Generation(
 } // end of WriteLastGen
 //========================================================================================================
 //
+// write the checkpoint from which a next part of the simulation
+// continues: the founders of the next generation (so after 
+// reproduction), the number of that generation and the
+// convergence history. The checkpoint is first written to a 
+// temporary file which then replaces the previous checkpoint, 
+// so that a run that is broken off always leaves a complete one
+void Write_Checkpoint(
+        Population & Pop, 
+        Convergence_Monitor & Mon,
+        int next_generation,
+        Params & Par)
+{
+    const char * filename = "checkpoint.bin";
+    const char * tmp_filename = "checkpoint.bin.tmp";
+
+    vector < double > values;
+    values.reserve(4 * Pop.size() + 4 * Mon.mean[0].size());
+
+    for (unsigned int col_i = 0; col_i < Pop.size(); ++col_i)
+    {
+        values.push_back(Pop[col_i].male.learn);
+        values.push_back(Pop[col_i].male.forget);
+        values.push_back(Pop[col_i].queen.learn);
+        values.push_back(Pop[col_i].queen.forget);
+    }
+
+    for (int allele_i = 0; allele_i < 2; ++allele_i)
+    {
+        values.insert(values.end(), Mon.mean[allele_i].begin(), Mon.mean[allele_i].end());
+        values.insert(values.end(), Mon.var[allele_i].begin(), Mon.var[allele_i].end());
+    }
+
+    Checkpoint_Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.seed = Par.seed;
+    header.simpart = simpart;
+    header.generation = next_generation;
+    header.colonies = Pop.size();
+    header.monitored = Mon.mean[0].size();
+    header.checksum = Checksum((const unsigned char *) values.data(), 
+            values.size() * sizeof(double));
+
+    FILE * file = fopen(tmp_filename, "wb");
+
+    if (file == NULL 
+            || fwrite(&header, sizeof(header), 1, file) != 1
+            || fwrite(values.data(), sizeof(double), values.size(), file) != values.size()
+            || fflush(file) != 0
+            || fsync(fileno(file)) != 0
+            || fclose(file) != 0
+            || rename(tmp_filename, filename) != 0)
+    {
+        cout << "error: cannot write " << filename << endl;
+        exit(1);
+    }
+}
+//========================================================================================================
+//
 // give names to each of the datafiles
 void Name_Data_Files(
         string &data1, 
@@ -1629,11 +2428,16 @@ void Name_Data_Files(
 // is this a continuation of a previous run, yes or no?
 // if yes, read in the last generation of the previous run and start from there
 // if no, just initialize everything
-void Continue_Previous_Run_Yes_No(Params & Par, Population & Pop) 
+void Continue_Previous_Run_Yes_No(Params & Par, Population & Pop, Convergence_Monitor & Mon) 
 {
-    // if a lastgen.txt file is present in the current directory
+    // if a checkpoint is present in the current directory
     // this means it is a continuation of an older run 
-	if (FileExists("lastgen.txt"))
+    if (FileExists("checkpoint.bin"))
+    {
+        Read_Checkpoint("checkpoint.bin", Par, Pop, Mon);
+    }
+    // runs without checkpoints only left their founders in lastgen.txt
+	else if (FileExists("lastgen.txt"))
     {
         ifstream inp("lastgen.txt");
         Read_LastGen_Data(inp, Par, Pop);
@@ -1650,7 +2454,7 @@ void Continue_Previous_Run_Yes_No(Params & Par, Population & Pop)
 
 // write out data of a single colony
 void Write_Col_Data(
-        Colony & Col,
+        ColonySummary & Col,
         ofstream & mydata,
         Params & Par,
         int gen,
@@ -1666,17 +2470,21 @@ void Write_Col_Data(
 
     mydata << ";" << Col.idle 
             << ";" << Col.inactive 
-            << ";" << Col.fitness 
-            << ";" << Col.stim[0] 
-            << ";" << Col.stim[1] 
-            << ";" << Col.mean_switches 
-            << ";" << Col.mean_workperiods << endl;  
+            << ";" << Col.fitness;
+
+	for (unsigned int task = 0; task < Par.tasks; ++task)
+    {
+        mydata << ";" << Col.stim[task];
+    }
+
+    mydata << ";" << Col.mean_switches 
+            << ";" << Col.mean_workperiods << "\n";  
 }
 //------------------------------------------------------------------------------------------------------
 // write out all the alleles to get an overview of
 // the amount of within and between colony genetic variation
 void Write_Alleles_Spec(
-        Colony & Col, 
+        ColonySummary & Col, 
         ofstream & data_reinforcement,
         ofstream & data_f,
         Params & Par,
@@ -1684,11 +2492,11 @@ void Write_Alleles_Spec(
 {
     data_reinforcement << gen << ";";
     data_reinforcement << Col.male.learn << ";"; 
-    data_reinforcement << Col.male.forget << endl; 
+    data_reinforcement << Col.male.forget << "\n"; 
 
 	data_reinforcement << gen <<";";
     data_reinforcement << Col.queen.learn << ";"; 
-    data_reinforcement << Col.queen.forget << endl; 
+    data_reinforcement << Col.queen.forget << "\n"; 
 
 	data_f << gen <<";" 
                 << Col.mean_Dx << ";" 
@@ -1696,46 +2504,184 @@ void Write_Alleles_Spec(
                 << Col.mean_workperiods << ";"
                 << Col.var_Dx << ";"
                 << Col.var_switches <<";" 
-                << Col.var_workperiods << endl;
+                << Col.var_workperiods << "\n";
 } 
+//------------------------------------------------------------------------------------------------------
+// the writer thread: write full batches in the order in which they 
+// came, flushing the files once per batch, until told to stop
+void Write_Batches(Output_Writer * W)
+{
+    unique_lock < mutex > guard(W->lock);
 
+    for (;;)
+    {
+        W->changed.wait(guard, [W] { return !W->full.empty() || W->stop; });
 
-//==============================================================================================================================================
+        if (W->full.empty())
+        {
+            return;
+        }
 
-// add headers to the data files
-void Header_data(ofstream & header, ofstream & header2)
-{
-	    header << "Gen" << ";" 
-		<< "Col"  << ";" 
-		<< "FitWork1" << ";" 
-		<< "FitWork2" << ";" 
-		<< "WorkAlloc1" << ";" 
-		<< "WorkAlloc2" <<";" 
-		<< "Idle"<< ";" 
-		<< "Inactive" << ";"
-		<<"Fitness" << ";" 
-		<< "End_stim1" << ";" 
-		<< "End_stim2" << ";"
-		<< "mean_switches" << ";"
-		<< "mean_workperiods" << endl; 
+        Output_Batch * batch = W->full.front();
+        W->full.pop_front();
+        ++W->writing;
 
-#ifdef WRITE_LASTGEN_PERSTEP
-        header2 << "Time" << ";" 
-		<< "Col" << ";" 
-		<< "Stim1" << ";" 
-		<< "Stim2" << ";" 
-		<< "Workers1" << ";"
-		<< "Workers2" << ";" 
-		<< "Fitness" << ";" 
-		<< "Mean_Dx" << endl;
-#endif   
-}
-//=======================================================================================================================
-//
-//
+        guard.unlock();
+
+        for (unsigned int col_i = 0; col_i < batch->colonies.size(); ++col_i)
+        {
+            // write out the data 
+            Write_Col_Data(batch->colonies[col_i], 
+                    *W->out_col, 
+                    *W->Par, 
+                    batch->generation, 
+                    col_i);
+
+            // write out alleles
+            Write_Alleles_Spec(
+                    batch->colonies[col_i], 
+                    *W->out_alleles, 
+                    *W->out_f, 
+                    *W->Par, 
+                    batch->generation);
+        }
+
+        W->out_col->flush();
+        W->out_alleles->flush();
+        W->out_f->flush();
+
+        guard.lock();
+
+        --W->writing;
+        W->free.push_back(batch);
+        W->changed.notify_all();
+    }
+}
+
+// start the writer thread, with two batches, so that one 
+// generation is written while the next one is simulated
+void Start_Writer(Output_Writer & W, 
+        Params & Par,
+        ofstream & out_col, 
+        ofstream & out_alleles, 
+        ofstream & out_f)
+{
+    W.batches.resize(2);
+
+    for (unsigned int batch_i = 0; batch_i < W.batches.size(); ++batch_i)
+    {
+        W.free.push_back(&W.batches[batch_i]);
+    }
+
+    W.writing = 0;
+    W.stop = false;
+    W.Par = &Par;
+    W.out_col = &out_col;
+    W.out_alleles = &out_alleles;
+    W.out_f = &out_f;
+
+    W.worker = thread(Write_Batches, &W);
+}
+
+// hand a generation's colonies to the writer thread, waiting 
+// for a free batch if the writer is behind. The colonies are 
+// copied, so they can be changed straight away (the copy reuses 
+// the batch's memory from earlier generations)
+void Write_Generation(Output_Writer & W, Population & Pop, int generation)
+{
+    unique_lock < mutex > guard(W.lock);
+
+    W.changed.wait(guard, [&W] { return !W.free.empty(); });
+
+    Output_Batch * batch = W.free.back();
+    W.free.pop_back();
+
+    guard.unlock();
+
+    batch->generation = generation;
+    batch->colonies.resize(Pop.size());
+    copy(Pop.begin(), Pop.end(), batch->colonies.begin());
+
+    guard.lock();
+
+    W.full.push_back(batch);
+    W.changed.notify_all();
+}
+
+// wait until everything handed to the writer thread is written,
+// e.g., before a checkpoint, so that the data files match it
+void Wait_Writer(Output_Writer & W)
+{
+    unique_lock < mutex > guard(W.lock);
+
+    W.changed.wait(guard, [&W] { return W.full.empty() && W.writing == 0; });
+}
+
+// write what is left and end the writer thread
+void Stop_Writer(Output_Writer & W)
+{
+    {
+        lock_guard < mutex > guard(W.lock);
+        W.stop = true;
+        W.changed.notify_all();
+    }
+
+    W.worker.join();
+}
+
+
+//==============================================================================================================================================
+
+// add headers to the data files
+// (the columns per task in the same order as Write_Col_Data
+// and Write_Data_1Gen write them)
+void Header_data(ofstream & header, ofstream & header2, Params & Par)
+{
+	    header << "Gen" << ";" 
+		<< "Col"  << ";";
+
+	for (unsigned int task = 1; task <= Par.tasks; ++task)
+    {
+        header << "FitWork" << task << ";" 
+		    << "WorkAlloc" << task << ";";
+    }
+
+    header << "Idle"<< ";" 
+		<< "Inactive" << ";"
+		<<"Fitness" << ";";
+
+	for (unsigned int task = 1; task <= Par.tasks; ++task)
+    {
+        header << "End_stim" << task << ";";
+    }
+
+    header << "mean_switches" << ";"
+		<< "mean_workperiods" << endl; 
+
+#ifdef WRITE_LASTGEN_PERSTEP
+        header2 << "Time" << ";" 
+		<< "Col" << ";";
+
+	for (unsigned int task = 1; task <= Par.tasks; ++task)
+    {
+        header2 << "Stim" << task << ";";
+    }
+
+	for (unsigned int task = 1; task <= Par.tasks; ++task)
+    {
+        header2 << "Workers" << task << ";";
+    }
+
+    header2 << "Fitness" << ";" 
+		<< "Mean_Dx" << endl;
+#endif   
+}
+//=======================================================================================================================
+//
+//
 //writing data of last generation step by step
 void Write_Data_1Gen(ofstream & mydata, 
-        Colony & Col, 
+        ColonySummary & Col, 
         unsigned int colony_number,
         Params & Par, 
         int timestep)
@@ -1761,70 +2707,99 @@ void Write_Data_1Gen(ofstream & mydata,
 }
 //==========================================================================================================================
 
+// header of the traces written by Write_Ants_Beh
+void Header_Ants_Beh(ofstream & mydata, Params & Par)
+{
+    mydata << "generation;time;col_id;"
+        << "meanswitches;meanworkperiods;"
+        << "sdswitches;sdworkperiods;";
+
+    for (unsigned int task_i = 0; task_i < Par.tasks; ++task_i)
+    {
+        mydata << "meanthreshold" << (task_i + 1) << ";";
+        mydata << "meancountact" << (task_i + 1) << ";";
+        mydata << "meanexperiencepoints" << (task_i + 1) << ";";
+        mydata << "meanalpha" << (task_i + 1) << ";";
+        mydata << "sdthreshold" << (task_i + 1) << ";";
+        mydata << "sdcountact" << (task_i + 1) << ";";
+        mydata << "sdexperiencepoints" << (task_i + 1) << ";";
+        mydata << "sdalpha" << (task_i + 1) << ";";
+        mydata << "stim" << (task_i + 1) << ";";
+    }
+
+    mydata << endl;
+}
+//==========================================================================================================================
+
 // write down individual ants
-void Write_Ants_Beh(Colony & Col, 
+template <unsigned int NT>
+void Write_Ants_Beh(Colony<NT> & Col, 
         unsigned int colony_number,
         unsigned int time_step,
         unsigned int generation,
-        ofstream & mydata,
+        ostream & mydata,
         Params &Par) 
 {
-    vector <double> meanth(Par.tasks,0);
-    vector <double> meancountact(Par.tasks,0);
-    vector <double> meanexperiencepoint(Par.tasks,0);
-    vector <double> meanalpha(Par.tasks,0);
+    Workers & W = Col.MyAnts;
+
+    typename Per_Task < double, NT >::type meanth;
+    Reset_Per_Task(meanth, Num_Tasks<NT>(Par), 0);
+    typename Per_Task < double, NT >::type meancountact;
+    Reset_Per_Task(meancountact, Num_Tasks<NT>(Par), 0);
+    typename Per_Task < double, NT >::type meanexperiencepoint;
+    Reset_Per_Task(meanexperiencepoint, Num_Tasks<NT>(Par), 0);
+    typename Per_Task < double, NT >::type meanalpha;
+    Reset_Per_Task(meanalpha, Num_Tasks<NT>(Par), 0);
 
     double meanswitches = 0;
     double meanworkperiods = 0;
 
-    vector <double> ssth(Par.tasks,0);
-    vector <double> sscountact(Par.tasks,0);
-    vector <double> ssexperiencepoint(Par.tasks,0);
-    vector <double> ssalpha(Par.tasks,0);
+    typename Per_Task < double, NT >::type ssth;
+    Reset_Per_Task(ssth, Num_Tasks<NT>(Par), 0);
+    typename Per_Task < double, NT >::type sscountact;
+    Reset_Per_Task(sscountact, Num_Tasks<NT>(Par), 0);
+    typename Per_Task < double, NT >::type ssexperiencepoint;
+    Reset_Per_Task(ssexperiencepoint, Num_Tasks<NT>(Par), 0);
+    typename Per_Task < double, NT >::type ssalpha;
+    Reset_Per_Task(ssalpha, Num_Tasks<NT>(Par), 0);
 
     double ssswitches = 0;
     double ssworkperiods = 0;
 
-    for (unsigned int ant = 0; ant < Col.MyAnts.size(); ++ant)
+    // go through each of the per-task arrays in turn
+    for (unsigned int task_i = 0; task_i < Num_Tasks<NT>(Par); ++task_i)
     {
-        for (unsigned int task_i = 0; task_i < Par.tasks; ++task_i)
-        {
-            meanth[task_i] += Col.MyAnts[ant].threshold[task_i];
-            
-            ssth[task_i] += Col.MyAnts[ant].threshold[task_i]
-                * Col.MyAnts[ant].threshold[task_i];
-
-
-
-            meancountact[task_i] += Col.MyAnts[ant].countacts[task_i];
-
-            sscountact[task_i] += Col.MyAnts[ant].countacts[task_i]
-                * Col.MyAnts[ant].countacts[task_i];
+        const double * threshold = &W.threshold[task_i * W.N];
+        const int * countacts = &W.countacts[task_i * W.N];
+        const double * experience_points = &W.experience_points[task_i * W.N];
+        const double * alpha = &W.alpha[task_i * W.N];
 
+        for (int ant = 0; ant < W.N; ++ant)
+        {
+            meanth[task_i] += threshold[ant];
+            ssth[task_i] += threshold[ant] * threshold[ant];
 
-            meanexperiencepoint[task_i] += 
-                Col.MyAnts[ant].experience_points[task_i];
+            meancountact[task_i] += countacts[ant];
+            sscountact[task_i] += countacts[ant] * countacts[ant];
 
+            meanexperiencepoint[task_i] += experience_points[ant];
             ssexperiencepoint[task_i] += 
-                Col.MyAnts[ant].experience_points[task_i]
-                *
-                Col.MyAnts[ant].experience_points[task_i];
-
-
-
-            meanalpha[task_i] += Col.MyAnts[ant].alpha[task_i];
+                experience_points[ant] * experience_points[ant];
 
-            ssalpha[task_i] += Col.MyAnts[ant].alpha[task_i] * 
-                Col.MyAnts[ant].alpha[task_i];
+            meanalpha[task_i] += alpha[ant];
+            ssalpha[task_i] += alpha[ant] * alpha[ant];
         }
+    }
 
-        meanswitches += Col.MyAnts[ant].switches;
-        ssswitches += Col.MyAnts[ant].switches * 
-            Col.MyAnts[ant].switches;
+    for (int ant = 0; ant < W.N; ++ant)
+    {
+        meanswitches += W.switches[ant];
+        ssswitches += W.switches[ant] * 
+            W.switches[ant];
 
-        meanworkperiods += Col.MyAnts[ant].workperiods;
-        ssworkperiods += Col.MyAnts[ant].workperiods * 
-            Col.MyAnts[ant].workperiods;
+        meanworkperiods += W.workperiods[ant];
+        ssworkperiods += W.workperiods[ant] * 
+            W.workperiods[ant];
     }
 
     meanswitches /= Par.N;
@@ -1832,28 +2807,6 @@ void Write_Ants_Beh(Colony & Col,
     ssswitches /= Par.N;
     ssworkperiods /= Par.N;
 
-    if (colony_number == 0 && time_step == 0 && generation == 0)
-    {
-        mydata << "generation;time;col_id;"
-            << "meanswitches;meanworkperiods;"
-            << "sdswitches;sdworkperiods;";
-
-        for (unsigned int task_i = 0; task_i < Par.tasks; ++task_i)
-        {
-            mydata << "meanthreshold" << (task_i + 1) << ";";
-            mydata << "meancountact" << (task_i + 1) << ";";
-            mydata << "meanexperiencepoints" << (task_i + 1) << ";";
-            mydata << "meanalpha" << (task_i + 1) << ";";
-            mydata << "sdthreshold" << (task_i + 1) << ";";
-            mydata << "sdcountact" << (task_i + 1) << ";";
-            mydata << "sdexperiencepoints" << (task_i + 1) << ";";
-            mydata << "sdalpha" << (task_i + 1) << ";";
-            mydata << "stim" << (task_i + 1) << ";";
-        }
-
-        mydata << endl;
-    }
-
     mydata << generation << ";" 
         << time_step << ";"
         << colony_number << ";"
@@ -1862,7 +2815,7 @@ void Write_Ants_Beh(Colony & Col,
         << sqrt(ssswitches - meanswitches * meanswitches) << ";"
         << sqrt(ssworkperiods - meanworkperiods * meanworkperiods) << ";";
 
-    for (unsigned int task_i = 0; task_i < Par.tasks; ++task_i)
+    for (unsigned int task_i = 0; task_i < Num_Tasks<NT>(Par); ++task_i)
     {
         meanth[task_i] /= Par.N;
 
@@ -1890,236 +2843,838 @@ void Write_Ants_Beh(Colony & Col,
             << Col.stim[task_i] << ";";
     }
 
-    mydata << endl;
+    mydata << "\n";
 }
 //=========================================================================================================
-// writing ants' thresholds 
-void Write_Ants_Thresholds(Population & Pop, ofstream & mydata, int timestep, int gen) 
+// write the traces of all colonies (see Write_Ants_Beh), in the 
+// order of the colonies and within a colony in the order of the 
+// timesteps, whatever the thread that simulated the colony
+void Write_Traces(vector < string > & traces, ofstream & mydata)
 {
-    for (unsigned int col = 0; col < Pop.size(); ++col)
+    for (unsigned int col_i = 0; col_i < traces.size(); ++col_i)
     {
-        for (unsigned int ant = 0; ant < Pop[col].MyAnts.size(); ++ant)
-        {
-            mydata << gen << ";" << timestep << ";" << col << ";" << Pop[col].MyAnts[ant].ID_ant << ";" 
-                << Pop[col].MyAnts[ant].threshold[0] << ";" 
-                << Pop[col].MyAnts[ant].threshold[1] << ";" 
-                << Pop[col].MyAnts[ant].countacts[0] << ";"
-                << Pop[col].MyAnts[ant].countacts[1] << ";"
-                << Pop[col].MyAnts[ant].experience_points[0] << ";"
-                << Pop[col].MyAnts[ant].experience_points[1] << ";"
-                << Pop[col].MyAnts[ant].alpha[0] << ";"
-                << Pop[col].MyAnts[ant].alpha[1] << endl; 
-        }
+        mydata << traces[col_i];
+        traces[col_i].clear();
     }
+
+    mydata.flush();
 }
-//================================================================================
-int main(int argc, char* argv[])
+//=========================================================================================================
+// whether any timestep of this colony in this generation can be traced
+bool Trace_Colony(Trace_Policy & T, int col_i, int generation)
 {
-    // initialize object to store all parameters
-    Params myPars;
-    
-    // get parameters from file
-    ifstream inp("params.txt");
-
-    // add these parameters to parameter object
-    myPars.Init_Params(inp);
+    return T.on 
+        && col_i >= T.first_colony && col_i <= T.last_colony
+        && generation >= T.first_generation && generation <= T.last_generation;
+}
 
-    int skip_threshold = myPars.maxgen / 1000;
+// start the trace of a colony that is traced
+template <unsigned int NT>
+void Start_Trace(Colony<NT> & Col, Params & Par)
+{
+    Col.trace.str("");
 
-    // set up the random number generators
-    // (from the gnu gsl library)
-    gsl_rng_env_setup();
-    T = gsl_rng_default;
-    rng_global = gsl_rng_alloc(T);
-    gsl_rng_set(rng_global, myPars.seed);
+    // with a trigger, nothing is traced until mean Dx crosses it
+    Col.trace_until = trace_policy.triggered ? 0 : Par.maxtime;
+    Col.trace_dx_side = 0;
+}
 
-    // also set the seed for one call to random_shuffle
-    srand(myPars.seed);
+// add a timestep to the trace of a colony that is traced
+// (see Trace_Policy)
+template <unsigned int NT>
+void Trace_Step(Colony<NT> & Col, Params & Par, int col_i, int time_step, int generation)
+{
+    Trace_Policy & T = trace_policy;
 
+    if (T.triggered)
+    {
+        // the specialization values of this timestep
+        Calc_D(Col, Par);
 
-    // initialize the founders of all the colonies
-    Population MyColonies;
-    Init_Founders_Generation_0(MyColonies, myPars);
+        // mean Dx is unknown (NaN) as long as no ant has worked twice
+        if (!std::isnan(Col.mean_Dx))
+        {
+            int side = Col.mean_Dx < T.dx_trigger ? -1 : 1;
 
-    // this simulation run might a a continuation of a previous 
-    // simulation, for example when that simulation was broken off
-    // prematurely. This function checks whether lastgen.txt (the output 
-    // of the previous simulation is present and initializes the simulation
-    // accordingly
-    Continue_Previous_Run_Yes_No(myPars, MyColonies);
+            if (Col.trace_dx_side != 0 && side != Col.trace_dx_side)
+            {
+                Col.trace_until = time_step + T.window;
+            }
 
-    // all the files to which data is written to
-    string datafile1, 
-           datafile2, 
-           datafile3, 
-           datafile4, 
-           datafile5, 
-           datafile6, 
-           dataants;
+            Col.trace_dx_side = side;
+        }
 
-    // function to give the datafiles particular names
-    Name_Data_Files(
-            datafile1, 
-            datafile2, 
-            datafile3, 
-            datafile4, 
-            datafile5, 
-            datafile6, 
-            dataants
-            );
+        if (time_step >= Col.trace_until)
+        {
+            return;
+        }
+    }
 
-    // the corresponding output files
-    static ofstream out1; 
-    static ofstream out2;
-    static ofstream out3;
-    static ofstream out4;
-    static ofstream out5;
-    static ofstream out6;
-    static ofstream header1;
-    static ofstream header2;
-    static ofstream out_ants;
+    if (time_step % T.every == 0)
+    {
+        Write_Ants_Beh(Col, col_i, time_step, generation, Col.trace, Par);
+    }
+}
+//=========================================================================================================
+// writing ants' thresholds 
+template <unsigned int NT>
+void Write_Ants_Thresholds(Colony<NT> & Col, unsigned int colony_number, ofstream & mydata, int timestep, int gen) 
+{
+    Workers & W = Col.MyAnts;
 
-    out1.open(datafile1.c_str());
+    for (int ant = 0; ant < W.N; ++ant)
+    {
+        mydata << gen << ";" << timestep << ";" << colony_number << ";" << ant;
 
-    header1.open("header_1.txt");
+        // all thresholds, then all counts of acts etc.
+        for (unsigned int task = 0; task < W.tasks; ++task)
+        {
+            mydata << ";" << W.threshold[task * W.N + ant];
+        }
 
-#ifdef WRITE_LASTGEN_PERSTEP 
-    header2.open("header2.txt");
-#endif
+        for (unsigned int task = 0; task < W.tasks; ++task)
+        {
+            mydata << ";" << W.countacts[task * W.N + ant];
+        }
 
-    // write headers to datafiles
-    Header_data(header1, header2);
-    
-    // data for the allelic distribution
-    out2.open(datafile2.c_str());
+        for (unsigned int task = 0; task < W.tasks; ++task)
+        {
+            mydata << ";" << W.experience_points[task * W.N + ant];
+        }
 
-    // add data headers
-    out2 << "generation;learn;forget" << endl;
+        for (unsigned int task = 0; task < W.tasks; ++task)
+        {
+            mydata << ";" << W.alpha[task * W.N + ant];
+        }
 
-    out3.open(datafile3.c_str());    
-    
-    
-    out4.open(datafile4.c_str());    
+        mydata << endl; 
+    }
+}
+//================================================================================
+// read a range of colonies or generations: a single number, 
+// a-b, or a- (from a onwards)
+void Read_Range(string range, int & first, int & last)
+{
+    size_t dash = range.find('-');
 
-#ifdef WRITE_LASTGEN_PERSTEP 
-    out_ants.open(dataants.c_str()); 
-    out5.open(datafile5.c_str());
-    out6.open(datafile6.c_str());
-#endif
+    first = atoi(range.substr(0, dash).c_str());
 
-    // calculate maximum number of generations
-    int maxgen = simstart_generation + myPars.maxgen;
+    if (dash == string::npos)
+    {
+        last = first;
+    }
+    else if (dash + 1 == range.size())
+    {
+        last = INT_MAX;
+    }
+    else
+    {
+        last = atoi(range.substr(dash + 1).c_str());
+    }
 
-    // now go evolve
-    for (int current_generation = simstart_generation; 
-            current_generation < maxgen; ++current_generation)
+    if (first < 0 || last < first)
     {
-        cout << "generation: " << current_generation << " end " << endl;
+        cout << "error: invalid range " << range << endl;
+        exit(1);
+    }
+}
 
-        double start_time = omp_get_wtime();
+// set the trace policy from a comma separated list of settings
+// (an empty list turns tracing off):
+// all                  trace every timestep of every colony 
+// every=k              only every k-th timestep
+// colonies=a-b         only these colonies (see Read_Range)
+// generations=a-b      only these generations
+// dx=value             only the timesteps after a colony's mean Dx 
+//                      crosses value (in either direction), 
+// window=steps         ... for this many timesteps (default 10)
+void Init_Trace_Policy(string spec, Trace_Policy & T)
+{
+    T.on = !spec.empty();
+    T.every = 1;
+    T.first_colony = 0;
+    T.last_colony = INT_MAX;
+    T.first_generation = 0;
+    T.last_generation = INT_MAX;
+    T.triggered = false;
+    T.dx_trigger = 0;
+    T.window = 10;
+
+    stringstream settings(spec);
+    string setting;
+
+    while (getline(settings, setting, ','))
+    {
+        size_t equals = setting.find('=');
+        string key = setting.substr(0, equals);
+        string value = equals == string::npos ? "" : setting.substr(equals + 1);
 
-        // now go through all colonies and let them do work
-        // for myPars.maxtime timesteps
-# pragma omp parallel num_threads(5)
+        if (key == "all" && value.empty())
         {
-# pragma omp for
-
-            for (unsigned int col_i = 0; col_i < myPars.Col; ++col_i)
-            {
-                // make a local copy of the colony to prevent 
-                // false sharing of MyColonies among threads
-                Colony Current_Colony = MyColonies[col_i];
+            continue;
+        }
+        else if (key == "every" && !value.empty())
+        {
+            T.every = atoi(value.c_str());
+        }
+        else if (key == "colonies" && !value.empty())
+        {
+            Read_Range(value, T.first_colony, T.last_colony);
+        }
+        else if (key == "generations" && !value.empty())
+        {
+            Read_Range(value, T.first_generation, T.last_generation);
+        }
+        else if (key == "dx" && !value.empty())
+        {
+            T.triggered = true;
+            T.dx_trigger = atof(value.c_str());
+        }
+        else if (key == "window" && !value.empty())
+        {
+            T.window = atoi(value.c_str());
+        }
+        else
+        {
+            cout << "error: unknown trace setting " << setting << endl;
+            exit(1);
+        }
+    }
 
-                // local parameter object
-                Params localParams = myPars;
+    if (T.every < 1 || T.window < 1)
+    {
+        cout << "error: every and window should be positive" << endl;
+        exit(1);
+    }
+}
+//================================================================================
+// read the run options from the command line:
+// -t <threads>                         number of threads (default: all cores)
+// -s <static|dynamic|guided>[,chunk]   how colonies are distributed over threads
+// -p                                   pin thread i to the i-th available core
+// -c                                   check the engine of the parameter regime 
+//                                      against the general engine and exit
+// -e <window>[,tolerance]              stop early once the founders' alleles 
+//                                      are stationary (see Converged, 
+//                                      default tolerance 0.05)
+// -T <policy>                          write per-step traces of the workers,
+//                                      see Init_Trace_Policy
+void Init_Run_Options(int argc, char* argv[], Run_Options & Opt)
+{
+    Opt.num_threads = omp_get_num_procs();
+    Opt.schedule = omp_sched_static;
+    Opt.chunk = 0;
+    Opt.pin = false;
+    Opt.check_regime = false;
+    Opt.stop_window = 0;
+    Opt.stop_tolerance = 0.05;
 
-                // make a local random number generator
-                gsl_rng *rng_local = gsl_rng_alloc(T);
-    
-                gsl_rng_set(rng_local, localParams.seed);
+    Init_Trace_Policy("", trace_policy);
 
-                // initialize each colony from sexuals
-                Init_Colony(Current_Colony, col_i, localParams, rng_local);
+    for (int arg_i = 1; arg_i < argc; ++arg_i)
+    {
+        string arg = argv[arg_i];
 
-                // timesteps during colony development
-                for (int k = 0; k < localParams.maxtime; ++k)
-                {
-                    // update all the stimuli of the ants 
-                    // and what they are doing
-                    Update_Ants(Current_Colony, localParams, rng_local);
+        if (arg == "-t" && arg_i + 1 < argc)
+        {
+            Opt.num_threads = atoi(argv[++arg_i]);
+        }
+        else if (arg == "-s" && arg_i + 1 < argc)
+        {
+            string schedule = argv[++arg_i];
+            size_t comma = schedule.find(',');
 
-                    // calculate specialization values
-                    Calc_D(Current_Colony, localParams); 
+            if (comma != string::npos)
+            {
+                Opt.chunk = atoi(schedule.substr(comma + 1).c_str());
+                schedule = schedule.substr(0, comma);
+            }
 
-                    // update statistics and if beyond tau, fitness values
-                    Update_Col_Data(k, Current_Colony, localParams);	
+            if (schedule == "static")
+            {
+                Opt.schedule = omp_sched_static;
+            }
+            else if (schedule == "dynamic")
+            {
+                Opt.schedule = omp_sched_dynamic;
+            }
+            else if (schedule == "guided")
+            {
+                Opt.schedule = omp_sched_guided;
+            }
+            else
+            {
+                cout << "error: unknown schedule " << schedule << endl;
+                exit(1);
+            }
+        }
+        else if (arg == "-p")
+        {
+            Opt.pin = true;
+        }
+        else if (arg == "-c")
+        {
+            Opt.check_regime = true;
+        }
+        else if (arg == "-e" && arg_i + 1 < argc)
+        {
+            string stop = argv[++arg_i];
+            size_t comma = stop.find(',');
 
-                    // calculate at the end of the timestep: 
-                    // the ants have done something
-                    // which has consequences for stimulus levels, 
-                    // which you update here
-                    Update_Stim(Current_Colony, localParams);
+            if (comma != string::npos)
+            {
+                Opt.stop_tolerance = atof(stop.substr(comma + 1).c_str());
+                stop = stop.substr(0, comma);
+            }
 
-#ifdef WRITE_LASTGEN_PERSTEP 
-                    Write_Ants_Beh(
-                            Current_Colony,
-                            col_i,
-                            k,
-                            current_generation,
-                            out_ants,
-                            localParams);
+            Opt.stop_window = atoi(stop.c_str());
+
+            if (Opt.stop_window < 1 || Opt.stop_tolerance < 0)
+            {
+                cout << "error: window should be positive and tolerance not negative" << endl;
+                exit(1);
+            }
+        }
+        else if (arg == "-T" && arg_i + 1 < argc)
+        {
+            Init_Trace_Policy(argv[++arg_i], trace_policy);
+        }
+        else
+        {
+            cout << "usage: " << argv[0] 
+                << " [-t threads] [-s static|dynamic|guided[,chunk]] [-p] [-c] [-e window[,tolerance]]"
+                << " [-T all|every=k,colonies=a-b,generations=a-b,dx=value,window=steps]" << endl;
+            exit(1);
+        }
+    }
+
+    if (Opt.num_threads < 1 || Opt.chunk < 0)
+    {
+        cout << "error: number of threads and chunk size should be positive" << endl;
+        exit(1);
+    }
+}
+
+// the cores this process is allowed to run on
+vector <int> Available_Cores()
+{
+    vector <int> cores;
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0)
+    {
+        for (int cpu_i = 0; cpu_i < CPU_SETSIZE; ++cpu_i)
+        {
+            if (CPU_ISSET(cpu_i, &cpus))
+            {
+                cores.push_back(cpu_i);
+            }
+        }
+    }
+
+    return cores;
+}
+
+// pin the calling thread to a single core
+void Pin_Thread(int core)
+{
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(core, &cpus);
+
+    sched_setaffinity(0, sizeof(cpus), &cpus);
+}
+
+//================================================================================
+// add the founders' allele distribution of a generation to the monitor
+void Record_Founders(Convergence_Monitor & Mon, Population & Pop)
+{
+    double sum[2] = { 0, 0 };
+    double sumsquares[2] = { 0, 0 };
+
+    for (unsigned int col_i = 0; col_i < Pop.size(); ++col_i)
+    {
+        Ant * founders[2] = { &Pop[col_i].queen, &Pop[col_i].male };
+
+        for (int founder_i = 0; founder_i < 2; ++founder_i)
+        {
+            double alleles[2] = { founders[founder_i]->learn, 
+                founders[founder_i]->forget };
+
+            for (int allele_i = 0; allele_i < 2; ++allele_i)
+            {
+                sum[allele_i] += alleles[allele_i];
+                sumsquares[allele_i] += alleles[allele_i] * alleles[allele_i];
+            }
+        }
+    }
+
+    double n = 2 * Pop.size();
+
+    for (int allele_i = 0; allele_i < 2; ++allele_i)
+    {
+        double mean = sum[allele_i] / n;
+
+        Mon.mean[allele_i].push_back(mean);
+        Mon.var[allele_i].push_back(max(sumsquares[allele_i] / n - mean * mean, 0.0));
+    }
+}
+
+// whether the founders' allele distribution has become stationary:
+// for both learn and forget, the mean over the last window generations
+// differs from the mean over the window before by at most tolerance 
+// standard deviations of the allele distribution, and so does its 
+// standard deviation. Needs at least two windows of generations
+bool Converged(Convergence_Monitor & Mon, int window, double tolerance)
+{
+    int generations = Mon.mean[0].size();
+
+    if (window <= 0 || generations < 2 * window)
+    {
+        return false;
+    }
+
+    bool converged = true;
+
+    for (int allele_i = 0; allele_i < 2; ++allele_i)
+    {
+        // averages over the window before (0) and the last window (1)
+        double mean[2] = { 0, 0 };
+        double var[2] = { 0, 0 };
+
+        for (int gen_i = generations - 2 * window; gen_i < generations; ++gen_i)
+        {
+            int window_i = gen_i >= generations - window;
+
+            mean[window_i] += Mon.mean[allele_i][gen_i] / window;
+            var[window_i] += Mon.var[allele_i][gen_i] / window;
+        }
+
+        Mon.sd[allele_i] = sqrt((var[0] + var[1]) / 2);
+        Mon.mean_drift[allele_i] = fabs(mean[1] - mean[0]);
+        Mon.sd_drift[allele_i] = fabs(sqrt(var[1]) - sqrt(var[0]));
+
+        if (Mon.mean_drift[allele_i] > tolerance * Mon.sd[allele_i] ||
+                Mon.sd_drift[allele_i] > tolerance * Mon.sd[allele_i])
+        {
+            converged = false;
+        }
+    }
+
+    return converged;
+}
+
+// record why and when the run stopped, in stop_<simpart>.txt
+void Write_Stop(Convergence_Monitor & Mon, 
+        int generation, 
+        bool converged, 
+        Run_Options & Opt)
+{
+    stringstream filename;
+    filename << "stop_" << simpart << ".txt";
+
+    ofstream stop_file(filename.str().c_str());
+
+    stop_file << "reason;generation;window;tolerance;" 
+        << "mean_learn;drift_mean_learn;drift_sd_learn;sd_learn;"
+        << "mean_forget;drift_mean_forget;drift_sd_forget;sd_forget" << endl;
+
+    stop_file << (converged ? "converged" : "maxgen") << ";"
+        << generation << ";"
+        << Opt.stop_window << ";"
+        << Opt.stop_tolerance;
+
+    for (int allele_i = 0; allele_i < 2; ++allele_i)
+    {
+        stop_file << ";" << Mon.mean[allele_i].back();
+
+        // drift only known when the test has been done
+        if (Opt.stop_window > 0 && int(Mon.mean[allele_i].size()) >= 2 * Opt.stop_window)
+        {
+            stop_file << ";" << Mon.mean_drift[allele_i]
+                << ";" << Mon.sd_drift[allele_i]
+                << ";" << Mon.sd[allele_i];
+        }
+        else
+        {
+            stop_file << ";NA;NA;NA";
+        }
+    }
+
+    stop_file << endl;
+}
+
+//================================================================================
+// simulate a single colony from its founders for maxtime timesteps
+// with the engine for NT tasks and regime R (see Regime_Flags),
+// in the workspace Col. The results go to Summary, and the 
+// per-step summaries of the workers selected by trace_policy to trace
+template <unsigned int NT, unsigned int R>
+void Simulate_Colony(Colony<NT> & Col, 
+        ColonySummary & Summary,
+        Params & Par,
+        int col_i,
+        int generation,
+        string & trace)
+{
+    // the random number streams of this colony
+    // in this generation. Those used every timestep are buffered,
+    // with room for about a timestep's worth of random numbers: 
+    // a word per ant (quitting, switching, the order of the ants) 
+    // and a gaussian per ant and task (threshold noise)
+    philox_rng rng_workers;
+
+    philox_rng_set(rng_workers, Par.seed, RNG_WORKERS, 
+            generation, col_i);
+    philox_buffer_set(Col.rng_ecology, Par.seed, RNG_ECOLOGY, 
+            generation, col_i, Par.N, Par.N * Num_Tasks<NT>(Par));
+    philox_buffer_set(Col.rng_order, Par.seed, RNG_ORDER, 
+            generation, col_i, Par.N, 0);
+
+    // colonies are simulated in parallel, so each colony 
+    // collects its own trace, see Write_Traces. Colonies that
+    // are not traced do not spend any time on tracing
+    bool traced = Trace_Colony(trace_policy, col_i, generation);
+
+    if (traced)
+    {
+        Start_Trace(Col, Par);
+    }
+
+    // initialize each colony from sexuals
+    Init_Colony(Col, 
+            col_i, 
+            Summary.queen,
+            Summary.male,
+            Par, 
+            rng_workers);
+
+    // timesteps during colony development
+    for (int k = 0; k < Par.maxtime; ++k)
+    {
+        // update all the stimuli of the ants 
+        // and what they are doing
+        Update_Ants<NT, R>(Col, Par, Col.rng_ecology, Col.rng_order);
+
+#ifdef CALC_D_PERSTEP
+        // calculate specialization values
+        Calc_D(Col, Par); 
 #endif
-                }
 
-                // calculate absolute fitness of this population
-                // in the last timestep
-                Calc_Abs_Fitness(Current_Colony, localParams);
-                
+        // update statistics and if beyond tau, fitness values
+        Update_Col_Data(k, Col, Par);	
+
+        // calculate at the end of the timestep: 
+        // the ants have done something
+        // which has consequences for stimulus levels, 
+        // which you update here
+        Update_Stim(Col, Par);
+
+        if (traced)
+        {
+            Trace_Step(Col, Par, col_i, k, generation);
+        }
+    }
+
+    if (traced)
+    {
+        trace = Col.trace.str();
+    }
+
+    // calculate specialization values
+    Calc_D(Col, Par); 
 
+    // calculate absolute fitness of this population
+    // in the last timestep
+    Calc_Abs_Fitness(Col, Par);
 
-                // return the current colony to the stack
-                MyColonies[col_i] = Current_Colony;
+    // hand back the results of this colony
+    Store_Colony_Summary(Col, Summary);
+}
 
+template <unsigned int NT>
+struct Colony_Simulator
+{
+    typedef void (*type)(Colony<NT> &, ColonySummary &, Params &, int, int, string &);
+};
+
+// pick the Simulate_Colony instantiation belonging to a regime,
+// one flag at a time
+template <unsigned int NT, unsigned int R>
+typename Colony_Simulator<NT>::type Select_Noise(unsigned int regime)
+{
+    return (regime & NO_NOISE) ? 
+        Simulate_Colony<NT, R | NO_NOISE> : Simulate_Colony<NT, R>;
+}
+
+template <unsigned int NT, unsigned int R>
+typename Colony_Simulator<NT>::type Select_Wait(unsigned int regime)
+{
+    if (regime & WAIT_ALWAYS)
+    {
+        return Select_Noise<NT, R | WAIT_ALWAYS>(regime);
+    }
+
+    if (regime & WAIT_NEVER)
+    {
+        return Select_Noise<NT, R | WAIT_NEVER>(regime);
+    }
+
+    return Select_Noise<NT, R>(regime);
+}
+
+template <unsigned int NT>
+typename Colony_Simulator<NT>::type Select_Colony_Simulator(unsigned int regime)
+{
+    if (regime & QUIT_ALWAYS)
+    {
+        return Select_Wait<NT, QUIT_ALWAYS>(regime);
+    }
+
+    if (regime & QUIT_BATCHED)
+    {
+        return Select_Wait<NT, QUIT_BATCHED>(regime);
+    }
+
+    return Select_Wait<NT, 0>(regime);
+}
+
+// test mode: simulate all colonies of the current generation once with 
+// the general engine and once with the engine of the regime, and 
+// check that the means over colonies of their statistics agree 
+// (within 4 standard errors; results of single colonies differ, 
+// as the regime's engine draws fewer random numbers).
+// Returns whether all statistics agree
+template <unsigned int NT>
+bool Check_Regime(Params & Par, Population & Founders, int generation, int num_threads)
+{
+    unsigned int regime = Regime_Of(Par);
+
+    typename Colony_Simulator<NT>::type simulators[2] = {
+        Simulate_Colony<NT, 0>, Select_Colony_Simulator<NT>(regime) };
+
+    Population results[2] = { Founders, Founders };
+
+    vector < Colony<NT> > workspaces(num_threads);
+
+    // the traces are not written
+    vector < string > traces(Par.Col);
+
+    for (int engine_i = 0; engine_i < 2; ++engine_i)
+    {
+# pragma omp parallel for num_threads(num_threads) schedule(runtime)
+        for (int col_i = 0; col_i < Par.Col; ++col_i)
+        {
+            simulators[engine_i](workspaces[omp_get_thread_num()], 
+                    results[engine_i][col_i], Par, 
+                    col_i, generation, traces[col_i]);
+        }
+    }
+
+    cout << "checking regime " << Regime_Name(regime) 
+        << " against the general engine over " << Par.Col << " colonies" << endl;
+    cout << "statistic;mean_general;mean_regime;z" << endl;
+
+    bool all_agree = true;
+
+    // statistic 0: fitness, 1: idle, 2: mean_switches, 
+    // 3: mean_workperiods, 4: mean_Dx, 5...: mean_work_alloc per task
+    for (unsigned int stat_i = 0; stat_i < 5 + Par.tasks; ++stat_i)
+    {
+        double mean[2] = { 0, 0 };
+        double var[2] = { 0, 0 };
+
+        for (int engine_i = 0; engine_i < 2; ++engine_i)
+        {
+            for (int col_i = 0; col_i < Par.Col; ++col_i)
+            {
+                ColonySummary & Col = results[engine_i][col_i];
+
+                double x = stat_i == 0 ? Col.fitness :
+                    stat_i == 1 ? Col.idle :
+                    stat_i == 2 ? Col.mean_switches :
+                    stat_i == 3 ? Col.mean_workperiods :
+                    stat_i == 4 ? Col.mean_Dx :
+                    Col.mean_work_alloc[stat_i - 5];
+
+                mean[engine_i] += x;
+                var[engine_i] += x * x;
             }
+
+            mean[engine_i] /= Par.Col;
+            var[engine_i] = var[engine_i] / Par.Col - mean[engine_i] * mean[engine_i];
+        }
+
+        double se = sqrt((var[0] + var[1]) / Par.Col);
+        double diff = mean[1] - mean[0];
+
+        // NaNs (e.g., mean_Dx without any specialists) agree with NaNs
+        bool both_nan = std::isnan(mean[0]) && std::isnan(mean[1]);
+        double z = se > 0 ? diff / se : (diff == 0 || both_nan ? 0 : INFINITY);
+
+        if (!both_nan && !(fabs(z) <= 4))
+        {
+            all_agree = false;
+        }
+
+        string names[5] = { "fitness", "idle", "mean_switches", 
+            "mean_workperiods", "mean_Dx" };
+
+        cout << (stat_i < 5 ? names[stat_i] : 
+                "mean_work_alloc" + to_string(stat_i - 4)) << ";" 
+            << mean[0] << ";" << mean[1] << ";" << z << endl;
+    }
+
+    cout << (all_agree ? "regime agrees with the general engine" 
+            : "error: regime differs from the general engine") << endl;
+
+    return all_agree;
+}
+
+//================================================================================
+// simulate all generations with the colony engine for NT tasks
+// (NT == 0: any number of tasks, see Num_Tasks)
+template <unsigned int NT>
+void Evolve(Params & myPars, 
+        Run_Options & myOptions, 
+        vector <int> & cores, 
+        Population & MyColonies,
+        Convergence_Monitor & monitor,
+        ofstream & out1,
+        ofstream & out2,
+        ofstream & out3,
+        ofstream & out5,
+        ofstream & out_ants)
+{
+    // calculate maximum number of generations
+    int maxgen = simstart_generation + myPars.maxgen;
+
+    // number of threads that simulate colonies
+    int num_threads = myOptions.num_threads;
+
+    // one colony workspace per thread, which is reused
+    // for every colony and generation that thread simulates
+    vector < Colony<NT> > workspaces(num_threads);
+
+    // the trace of each colony in the current generation
+    // (see Trace_Policy)
+    vector < string > traces(myPars.Col);
+
+    // the engine for the regime of the parameters 
+    unsigned int regime = Regime_Of(myPars);
+
+    typename Colony_Simulator<NT>::type simulate = 
+        Select_Colony_Simulator<NT>(regime);
+
+    cout << "regime " << Regime_Name(regime) << endl;
+
+    if (myOptions.check_regime)
+    {
+        exit(Check_Regime<NT>(myPars, MyColonies, 
+                    simstart_generation, num_threads) ? 0 : 1);
+    }
+
+    // time each thread spends simulating colonies in a generation,
+    // to show how well the load is balanced
+    vector < double > busy_time(num_threads);
+    vector < int > colonies_done(num_threads);
+
+    // to stop once the founders' alleles no longer change
+    bool converged = false;
+
+    // writes the data files in the background
+    Output_Writer writer;
+    Start_Writer(writer, myPars, out1, out2, out3);
+
+    // now go evolve
+    for (int current_generation = simstart_generation; 
+            current_generation < maxgen; ++current_generation)
+    {
+        cout << "generation: " << current_generation << " end " << endl;
+
+        double start_time = omp_get_wtime();
+
+        // now go through all colonies and let them do work
+        // for myPars.maxtime timesteps
+# pragma omp parallel num_threads(num_threads)
+        {
+            int thread_i = omp_get_thread_num();
+
+            if (myOptions.pin)
+            {
+                Pin_Thread(cores[thread_i % cores.size()]);
+            }
+
+            // the workspace owned by this thread
+            Colony<NT> & Current_Colony = workspaces[thread_i];
+
+            double thread_busy_time = 0;
+            int thread_colonies_done = 0;
+
+# pragma omp for schedule(runtime) nowait
+
+            for (int col_i = 0; col_i < myPars.Col; ++col_i)
+            {
+                double colony_start_time = omp_get_wtime();
+
+                // simulate this colony with the regime's engine
+                simulate(Current_Colony, MyColonies[col_i], myPars, 
+                        col_i, current_generation, traces[col_i]);
+
+                thread_busy_time += omp_get_wtime() - colony_start_time;
+                ++thread_colonies_done;
+            }
+
+            busy_time[thread_i] = thread_busy_time;
+            colonies_done[thread_i] = thread_colonies_done;
         }
 
         double stop_time = omp_get_wtime();
 
         cout << "time: " << (stop_time - start_time) << endl;
-        
-        start_time = omp_get_wtime();
 
+        if (trace_policy.on)
+        {
+            Write_Traces(traces, out_ants);
+        }
+
+        // busy time and number of colonies of each thread
+        cout << "busy time per thread:";
+
+        for (int thread_i = 0; thread_i < num_threads; ++thread_i)
+        {
+            cout << " " << busy_time[thread_i] 
+                << " (" << colonies_done[thread_i] << ")";
+
+            busy_time[thread_i] = 0;
+            colonies_done[thread_i] = 0;
+        }
+
+        cout << endl;
+        
         // calculate relative fitness values
         Calc_Rel_Fitness(MyColonies, myPars);
-        
-        stop_time = omp_get_wtime();
-        cout << "time produce sexuals: " << (stop_time - start_time) << endl;
 
-        // now calculate relative fitness 
-        // write stats and let colonies reproduce
-        //
-        // we cannot use any multicore processing here,
-        // as relative fitnes needs to be calculated wrt colony order
-        for (unsigned int col_i = 0; col_i < MyColonies.size(); ++col_i)
-        {
-            // write out the data 
-            Write_Col_Data(MyColonies[col_i], 
-                    out1, 
-                    myPars, 
-                    current_generation, 
-                    col_i);
+        // the writer thread writes the stats of this generation,
+        // while the colonies reproduce and the next generation 
+        // is simulated
+        Write_Generation(writer, MyColonies, current_generation);
 
-            // write out alleles
-            Write_Alleles_Spec(
-                    MyColonies[col_i], 
-                    out2, 
-                    out3, 
-                    myPars, 
-                    current_generation);
+        Record_Founders(monitor, MyColonies);
+
+        converged = Converged(monitor, 
+                myOptions.stop_window, myOptions.stop_tolerance);
+
+        // the last generation of this run, also when it stops early
+        bool last_generation = converged || current_generation == maxgen - 1;
 
 #ifdef WRITE_LASTGEN_PERSTEP
-            //do you want to write out the last generation step by step?
-            if (current_generation == simstart_generation + myPars.maxgen-1) 
+        //do you want to write out the last generation step by step?
+        if (last_generation) 
+        {
+            for (unsigned int col_i = 0; col_i < MyColonies.size(); ++col_i)
             {
                 Write_Data_1Gen(out5, 
                         MyColonies[col_i], 
@@ -2127,9 +3682,8 @@ int main(int argc, char* argv[])
                         myPars, 
                         myPars.maxtime);
             }
-#endif
-
         }
+#endif
       
 //        // write threshold data once every while
 //        if (current_generation % skip_threshold == 0)
@@ -2142,18 +3696,196 @@ int main(int argc, char* argv[])
 //        }
 
 
-
         Write_Last_Generation(
                 MyColonies, 
                 current_generation, 
-                myPars);
+                myPars,
+                last_generation);
 
-        if (current_generation < myPars.maxgen - 1)
+        if (last_generation)
         {
-            Make_Sexuals(MyColonies, myPars);
-            
-            Make_Colonies(MyColonies);
+            if (converged)
+            {
+                cout << "converged at generation " << current_generation << endl;
+            }
+
+            Write_Stop(monitor, current_generation, converged, myOptions);
+        }
+
+        start_time = omp_get_wtime();
+
+        // the random number stream used to pair sexuals into colonies
+        philox_rng rng_reproduction;
+        philox_rng_set(rng_reproduction, myPars.seed, RNG_REPRODUCTION,
+                current_generation, 0);
+
+        // also after the last generation, for the checkpoint
+        Make_Sexuals(MyColonies, myPars, current_generation, num_threads);
+        
+        Make_Colonies(MyColonies, rng_reproduction);
+
+        stop_time = omp_get_wtime();
+        cout << "time produce sexuals: " << (stop_time - start_time) << endl;
+
+        if (current_generation % 10 == 0 || last_generation)
+        {
+            // the data files should hold all generations before the checkpoint
+            Wait_Writer(writer);
+
+            Write_Checkpoint(MyColonies, monitor, current_generation + 1, myPars);
+        }
+
+        if (last_generation)
+        {
+            break;
         }
         
     } // end for generations
+
+    Stop_Writer(writer);
+}
+//================================================================================
+int main(int argc, char* argv[])
+{
+    // threads, scheduling and pinning
+    Run_Options myOptions;
+    Init_Run_Options(argc, argv, myOptions);
+
+    // initialize object to store all parameters
+    Params myPars;
+    
+    // get parameters from file
+    ifstream inp("params.txt");
+
+    // add these parameters to parameter object
+    myPars.Init_Params(inp);
+
+    // tabulate efficiency as a function of experience
+    Init_Efficiency_Table(myPars);
+
+    cout << "worker update kernel " << update_task_kernel_name(worker_kernel) << endl;
+
+    // distribute colonies over threads as given on the command line,
+    // see the schedule(runtime) clause below
+    omp_set_schedule(myOptions.schedule, myOptions.chunk);
+
+    // when pinning, thread i runs on the i-th core available to us
+    vector <int> cores = Available_Cores();
+
+    if (myOptions.pin && cores.empty())
+    {
+        cout << "warning: cannot determine the available cores, threads are not pinned" << endl;
+        myOptions.pin = false;
+    }
+
+    cout << "threads " << myOptions.num_threads 
+        << (myOptions.pin ? " (pinned)" : "") << endl;
+
+    int skip_threshold = myPars.maxgen / 1000;
+
+
+    // initialize the founders of all the colonies
+    Population MyColonies;
+    Init_Founders_Generation_0(MyColonies, myPars);
+
+    // the founders' allele distribution over the generations,
+    // to stop once it no longer changes (see Converged)
+    Convergence_Monitor monitor;
+
+    // this simulation run might a a continuation of a previous 
+    // simulation, for example when that simulation was broken off
+    // prematurely. This function checks whether checkpoint.bin or lastgen.txt 
+    // (the output of the previous simulation) is present and initializes 
+    // the simulation accordingly
+    Continue_Previous_Run_Yes_No(myPars, MyColonies, monitor);
+
+    // all the files to which data is written to
+    string datafile1, 
+           datafile2, 
+           datafile3, 
+           datafile4, 
+           datafile5, 
+           datafile6, 
+           dataants;
+
+    // function to give the datafiles particular names
+    Name_Data_Files(
+            datafile1, 
+            datafile2, 
+            datafile3, 
+            datafile4, 
+            datafile5, 
+            datafile6, 
+            dataants
+            );
+
+    // the corresponding output files
+    static ofstream out1; 
+    static ofstream out2;
+    static ofstream out3;
+    static ofstream out4;
+    static ofstream out5;
+    static ofstream out6;
+    static ofstream header1;
+    static ofstream header2;
+    static ofstream out_ants;
+
+    out1.open(datafile1.c_str());
+
+    header1.open("header_1.txt");
+
+#ifdef WRITE_LASTGEN_PERSTEP 
+    header2.open("header2.txt");
+#endif
+
+    // write headers to datafiles
+    Header_data(header1, header2, myPars);
+    
+    // data for the allelic distribution
+    out2.open(datafile2.c_str());
+
+    // add data headers
+    out2 << "generation;learn;forget" << endl;
+
+    out3.open(datafile3.c_str());    
+    
+    
+    out4.open(datafile4.c_str());    
+
+    // per-step traces, see Trace_Policy
+    if (trace_policy.on)
+    {
+        out_ants.open(dataants.c_str()); 
+        Header_Ants_Beh(out_ants, myPars);
+    }
+
+#ifdef WRITE_LASTGEN_PERSTEP 
+    out5.open(datafile5.c_str());
+    out6.open(datafile6.c_str());
+#endif
+
+    // run the colony engine compiled for this number of tasks
+    switch (myPars.tasks)
+    {
+        case 2:
+            Evolve<2>(myPars, myOptions, cores, MyColonies, monitor,
+                    out1, out2, out3, out5, out_ants);
+            break;
+        case 3:
+            Evolve<3>(myPars, myOptions, cores, MyColonies, monitor,
+                    out1, out2, out3, out5, out_ants);
+            break;
+        case 4:
+            Evolve<4>(myPars, myOptions, cores, MyColonies, monitor,
+                    out1, out2, out3, out5, out_ants);
+            break;
+        case 8:
+            Evolve<8>(myPars, myOptions, cores, MyColonies, monitor,
+                    out1, out2, out3, out5, out_ants);
+            break;
+        default:
+            Evolve<0>(myPars, myOptions, cores, MyColonies, monitor,
+                    out1, out2, out3, out5, out_ants);
+            break;
+    }
 }
@@ -0,0 +1,227 @@
+#ifndef TASK_SETS_H_
+#define TASK_SETS_H_
+
+// sets of tasks, stored as bitsets of 64 bit words (task i is bit
+// i % 64 of word i / 64), so that with up to 64 tasks a set fits in
+// a single word and finding or counting its tasks takes a single
+// instruction, whatever the number of tasks
+//
+// used for the tasks an ant wants to do. The tasks an ant wants
+// when she chooses a task are found by comparing the stimuli with
+// her thresholds for all tasks at once: there is a scalar version,
+// and AVX2 and AVX-512 versions that give identical results. As in
+// worker_kernels.h, the fastest version supported by the cpu is
+// chosen at runtime, unless SCALAR_KERNELS is defined
+
+#include <stdint.h>
+
+#if defined(__x86_64__) && !defined(SCALAR_KERNELS)
+#define TASK_SETS_X86
+#include <immintrin.h>
+#endif
+
+// number of words of a set of ntasks tasks
+inline unsigned int task_set_words(unsigned int ntasks)
+{
+    return (ntasks + 63) / 64;
+}
+
+inline bool task_set_has(const uint64_t * set, unsigned int task)
+{
+    return (set[task / 64] >> (task % 64)) & 1;
+}
+
+inline void task_set_add(uint64_t * set, unsigned int task)
+{
+    set[task / 64] |= (uint64_t) 1 << (task % 64);
+}
+
+inline void task_set_remove(uint64_t * set, unsigned int task)
+{
+    set[task / 64] &= ~((uint64_t) 1 << (task % 64));
+}
+
+inline void task_set_clear(uint64_t * set, unsigned int words)
+{
+    for (unsigned int word_i = 0; word_i < words; ++word_i)
+    {
+        set[word_i] = 0;
+    }
+}
+
+// number of tasks in the set
+inline unsigned int task_set_count(const uint64_t * set, unsigned int words)
+{
+    unsigned int count = 0;
+
+    for (unsigned int word_i = 0; word_i < words; ++word_i)
+    {
+        count += __builtin_popcountll(set[word_i]);
+    }
+
+    return count;
+}
+
+// lowest task in the set (-1 if the set is empty)
+inline int task_set_first(const uint64_t * set, unsigned int words)
+{
+    for (unsigned int word_i = 0; word_i < words; ++word_i)
+    {
+        if (set[word_i] != 0)
+        {
+            return word_i * 64 + __builtin_ctzll(set[word_i]);
+        }
+    }
+
+    return -1;
+}
+
+// position of the k-th (counting from 0) set bit of a word,
+// which must have more than k bits set
+inline unsigned int select_bit(uint64_t word, unsigned int k)
+{
+#ifdef __BMI2__
+    return __builtin_ctzll(_pdep_u64((uint64_t) 1 << k, word));
+#else
+    unsigned int offset = 0;
+
+    // skip whole bytes
+    for (unsigned int count; k >= (count = __builtin_popcountll(word & 0xFF)); )
+    {
+        k -= count;
+        word >>= 8;
+        offset += 8;
+    }
+
+    // then clear the lowest k bits of the remaining byte
+    for (; k > 0; --k)
+    {
+        word &= word - 1;
+    }
+
+    return offset + __builtin_ctzll(word);
+#endif
+}
+
+// k-th lowest task in the set (counting from 0), the set must
+// contain more than k tasks
+inline unsigned int task_set_select(const uint64_t * set, unsigned int k)
+{
+    unsigned int word_i = 0;
+
+    for (unsigned int count; k >= (count = __builtin_popcountll(set[word_i])); ++word_i)
+    {
+        k -= count;
+    }
+
+    return word_i * 64 + select_bit(set[word_i], k);
+}
+
+// write to wanted the set of tasks for which the stimulus is positive
+// and at least the threshold
+typedef void (*wanted_tasks_kernel)(unsigned int ntasks,
+        const double * stim,
+        const double * threshold,
+        uint64_t * wanted);
+
+inline void wanted_tasks_scalar(unsigned int ntasks,
+        const double * stim,
+        const double * threshold,
+        uint64_t * wanted)
+{
+    task_set_clear(wanted, task_set_words(ntasks));
+
+    for (unsigned int task_i = 0; task_i < ntasks; ++task_i)
+    {
+        wanted[task_i / 64] |= (uint64_t)
+            (stim[task_i] >= threshold[task_i] && stim[task_i] > 0) << (task_i % 64);
+    }
+}
+
+#ifdef TASK_SETS_X86
+
+__attribute__((target("avx2")))
+inline void wanted_tasks_avx2(unsigned int ntasks,
+        const double * stim,
+        const double * threshold,
+        uint64_t * wanted)
+{
+    const __m256d zero = _mm256_setzero_pd();
+
+    task_set_clear(wanted, task_set_words(ntasks));
+
+    unsigned int task_i = 0;
+
+    // 4 tasks at a time; as 64 is a multiple of 4, the
+    // bits of 4 tasks never straddle two words
+    for (; task_i + 4 <= ntasks; task_i += 4)
+    {
+        __m256d s = _mm256_loadu_pd(stim + task_i);
+
+        __m256d want = _mm256_and_pd(
+                _mm256_cmp_pd(s, _mm256_loadu_pd(threshold + task_i), _CMP_GE_OQ),
+                _mm256_cmp_pd(s, zero, _CMP_GT_OQ));
+
+        wanted[task_i / 64] |= (uint64_t) _mm256_movemask_pd(want) << (task_i % 64);
+    }
+
+    for (; task_i < ntasks; ++task_i)
+    {
+        wanted[task_i / 64] |= (uint64_t)
+            (stim[task_i] >= threshold[task_i] && stim[task_i] > 0) << (task_i % 64);
+    }
+}
+
+__attribute__((target("avx512f")))
+inline void wanted_tasks_avx512(unsigned int ntasks,
+        const double * stim,
+        const double * threshold,
+        uint64_t * wanted)
+{
+    const __m512d zero = _mm512_setzero_pd();
+
+    task_set_clear(wanted, task_set_words(ntasks));
+
+    unsigned int task_i = 0;
+
+    for (; task_i + 8 <= ntasks; task_i += 8)
+    {
+        __m512d s = _mm512_loadu_pd(stim + task_i);
+
+        __mmask8 want =
+            _mm512_cmp_pd_mask(s, _mm512_loadu_pd(threshold + task_i), _CMP_GE_OQ)
+            & _mm512_cmp_pd_mask(s, zero, _CMP_GT_OQ);
+
+        wanted[task_i / 64] |= (uint64_t) want << (task_i % 64);
+    }
+
+    for (; task_i < ntasks; ++task_i)
+    {
+        wanted[task_i / 64] |= (uint64_t)
+            (stim[task_i] >= threshold[task_i] && stim[task_i] > 0) << (task_i % 64);
+    }
+}
+
+#endif
+
+// choose the widest kernel the cpu supports
+inline wanted_tasks_kernel select_wanted_tasks_kernel()
+{
+#ifdef TASK_SETS_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        return wanted_tasks_avx512;
+    }
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return wanted_tasks_avx2;
+    }
+#endif
+
+    return wanted_tasks_scalar;
+}
+
+#endif
@@ -0,0 +1,335 @@
+#ifndef WORKER_KERNELS_H_
+#define WORKER_KERNELS_H_
+
+// colony-wide update of the thresholds, experience and efficiency
+// of all workers for one task, once all workers have chosen their
+// task for this timestep.
+//
+// per worker:
+//      if it works on the task: threshold -= learn, experience += step_gain
+//      otherwise:               threshold += forget, experience -= step_lose
+//      both clamped at 0, after which the efficiency is looked up
+//      from a table of experience levels (or evaluated directly if the
+//      experience is off the table)
+//
+// there is a scalar version, and AVX2 and AVX-512 versions that
+// give bit-identical results. The fastest version supported by the
+// cpu is chosen at runtime, unless SCALAR_KERNELS is defined
+
+#include <cmath>
+#include <cstdlib>
+
+#if defined(__x86_64__) && !defined(SCALAR_KERNELS)
+#define WORKER_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+// efficiency lookup of one task, see Init_Efficiency_Table
+struct efficiency_lookup
+{
+    const double * table; // efficiency per experience level
+    int levels; // number of levels in table (0: no table)
+    double inv_unit; // 1 / experience unit of a level
+    double K; // steepness of the sigmoid
+    double alpha_min;
+    double alpha_max;
+};
+
+// direct evaluation of the sigmoid
+// alpha = alpha_max * alpha_min * exp(K * e) / (alpha_min * exp(K * e) + 1 - alpha_min)
+inline double efficiency_direct(double K,
+        double alpha_min,
+        double alpha_max,
+        double experience)
+{
+    double tmp_1 = K * experience;
+    double tmp_2 = alpha_min * exp(tmp_1);
+
+    return alpha_max * tmp_2 /
+        (tmp_2 + (1 - alpha_min));
+}
+
+// tabulated efficiency, falling back to direct evaluation when
+// the experience is not (within rounding error) on a tabulated level
+inline double efficiency_eval(const efficiency_lookup & eff, double experience)
+{
+    double level = experience * eff.inv_unit;
+    long level_i = lround(level);
+
+    if (level_i < eff.levels && fabs(level - level_i) < 1e-6)
+    {
+        return eff.table[level_i];
+    }
+
+    return efficiency_direct(eff.K, eff.alpha_min, eff.alpha_max, experience);
+}
+
+// update a single worker; all kernels use this for their remainder
+inline void update_worker_task(int ant_i,
+        int task,
+        const int * curr_act,
+        const double * learn,
+        const double * forget,
+        double * threshold,
+        double * experience,
+        double * alpha,
+        double step_gain,
+        double step_lose,
+        const efficiency_lookup & eff)
+{
+    if (curr_act[ant_i] == task)
+    {
+        threshold[ant_i] -= learn[ant_i];
+        experience[ant_i] += step_gain;
+    }
+    else
+    {
+        threshold[ant_i] += forget[ant_i];
+        experience[ant_i] -= step_lose;
+    }
+
+    if (threshold[ant_i] < 0)
+    {
+        threshold[ant_i] = 0;
+    }
+
+    if (experience[ant_i] < 0)
+    {
+        experience[ant_i] = 0;
+    }
+
+    alpha[ant_i] = efficiency_eval(eff, experience[ant_i]);
+}
+
+typedef void (*update_task_kernel)(int n,
+        int task,
+        const int * curr_act,
+        const double * learn,
+        const double * forget,
+        double * threshold,
+        double * experience,
+        double * alpha,
+        double step_gain,
+        double step_lose,
+        const efficiency_lookup & eff);
+
+inline void update_task_scalar(int n,
+        int task,
+        const int * curr_act,
+        const double * learn,
+        const double * forget,
+        double * threshold,
+        double * experience,
+        double * alpha,
+        double step_gain,
+        double step_lose,
+        const efficiency_lookup & eff)
+{
+    for (int ant_i = 0; ant_i < n; ++ant_i)
+    {
+        update_worker_task(ant_i, task, curr_act, learn, forget,
+                threshold, experience, alpha, step_gain, step_lose, eff);
+    }
+}
+
+#ifdef WORKER_KERNELS_X86
+
+// note on the clamping: max(0, x) returns x when x is -0 or NaN,
+// just like 'if (x < 0) x = 0' in the scalar version
+//
+// the masked forms of the intrinsics with an all-ones mask are used 
+// where the plain forms pass an undefined source operand, about which
+// gcc warns (-Wmaybe-uninitialized)
+
+__attribute__((target("avx2")))
+inline void update_task_avx2(int n,
+        int task,
+        const int * curr_act,
+        const double * learn,
+        const double * forget,
+        double * threshold,
+        double * experience,
+        double * alpha,
+        double step_gain,
+        double step_lose,
+        const efficiency_lookup & eff)
+{
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    const __m256d gain = _mm256_set1_pd(step_gain);
+    const __m256d lose = _mm256_set1_pd(step_lose);
+    const __m256d inv_unit = _mm256_set1_pd(eff.inv_unit);
+    const __m256d tolerance = _mm256_set1_pd(1e-6);
+    const __m256d levels = _mm256_set1_pd(eff.levels);
+    const __m128i task_v = _mm_set1_epi32(task);
+    const __m256d all_lanes = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+
+    int ant_i = 0;
+
+    for (; ant_i + 4 <= n; ant_i += 4)
+    {
+        // all bits set in the lanes of workers doing this task
+        __m128i act = _mm_loadu_si128((const __m128i *) (curr_act + ant_i));
+        __m256d working = _mm256_castsi256_pd(
+                _mm256_cvtepi32_epi64(_mm_cmpeq_epi32(act, task_v)));
+
+        __m256d thr = _mm256_loadu_pd(threshold + ant_i);
+        thr = _mm256_blendv_pd(
+                _mm256_add_pd(thr, _mm256_loadu_pd(forget + ant_i)),
+                _mm256_sub_pd(thr, _mm256_loadu_pd(learn + ant_i)),
+                working);
+        _mm256_storeu_pd(threshold + ant_i, _mm256_max_pd(zero, thr));
+
+        __m256d exper = _mm256_loadu_pd(experience + ant_i);
+        exper = _mm256_blendv_pd(
+                _mm256_sub_pd(exper, lose),
+                _mm256_add_pd(exper, gain),
+                working);
+        exper = _mm256_max_pd(zero, exper);
+        _mm256_storeu_pd(experience + ant_i, exper);
+
+        // efficiency: gather from the table if all four are on it
+        __m256d level = _mm256_mul_pd(exper, inv_unit);
+        __m256d level_r = _mm256_round_pd(level,
+                _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        __m256d on_table = _mm256_and_pd(
+                _mm256_cmp_pd(_mm256_andnot_pd(sign,
+                        _mm256_sub_pd(level, level_r)), tolerance, _CMP_LT_OQ),
+                _mm256_cmp_pd(level_r, levels, _CMP_LT_OQ));
+
+        if (_mm256_movemask_pd(on_table) == 0xF)
+        {
+            _mm256_storeu_pd(alpha + ant_i,
+                    _mm256_mask_i32gather_pd(zero, eff.table,
+                        _mm256_cvtpd_epi32(level_r), all_lanes, 8));
+        }
+        else
+        {
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                alpha[ant_i + lane] = efficiency_eval(eff, experience[ant_i + lane]);
+            }
+        }
+    }
+
+    for (; ant_i < n; ++ant_i)
+    {
+        update_worker_task(ant_i, task, curr_act, learn, forget,
+                threshold, experience, alpha, step_gain, step_lose, eff);
+    }
+}
+
+__attribute__((target("avx512f")))
+inline void update_task_avx512(int n,
+        int task,
+        const int * curr_act,
+        const double * learn,
+        const double * forget,
+        double * threshold,
+        double * experience,
+        double * alpha,
+        double step_gain,
+        double step_lose,
+        const efficiency_lookup & eff)
+{
+    const __m512d zero = _mm512_setzero_pd();
+    const __m512d gain = _mm512_set1_pd(step_gain);
+    const __m512d lose = _mm512_set1_pd(step_lose);
+    const __m512d inv_unit = _mm512_set1_pd(eff.inv_unit);
+    const __m512d tolerance = _mm512_set1_pd(1e-6);
+    const __m512d levels = _mm512_set1_pd(eff.levels);
+    const __m512i task_v = _mm512_set1_epi64(task);
+    const __mmask8 all_lanes = 0xFF;
+
+    int ant_i = 0;
+
+    for (; ant_i + 8 <= n; ant_i += 8)
+    {
+        __m512i act = _mm512_maskz_cvtepi32_epi64(all_lanes,
+                _mm256_loadu_si256((const __m256i *) (curr_act + ant_i)));
+        __mmask8 working = _mm512_cmpeq_epi64_mask(act, task_v);
+
+        __m512d thr = _mm512_loadu_pd(threshold + ant_i);
+        thr = _mm512_mask_blend_pd(working,
+                _mm512_add_pd(thr, _mm512_loadu_pd(forget + ant_i)),
+                _mm512_sub_pd(thr, _mm512_loadu_pd(learn + ant_i)));
+        _mm512_storeu_pd(threshold + ant_i, _mm512_maskz_max_pd(all_lanes, zero, thr));
+
+        __m512d exper = _mm512_loadu_pd(experience + ant_i);
+        exper = _mm512_mask_blend_pd(working,
+                _mm512_sub_pd(exper, lose),
+                _mm512_add_pd(exper, gain));
+        exper = _mm512_maskz_max_pd(all_lanes, zero, exper);
+        _mm512_storeu_pd(experience + ant_i, exper);
+
+        __m512d level = _mm512_mul_pd(exper, inv_unit);
+        __m512d level_r = _mm512_maskz_roundscale_pd(all_lanes, level,
+                _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        __mmask8 on_table =
+            _mm512_cmp_pd_mask(_mm512_abs_pd(_mm512_sub_pd(level, level_r)),
+                    tolerance, _CMP_LT_OQ)
+            & _mm512_cmp_pd_mask(level_r, levels, _CMP_LT_OQ);
+
+        if (on_table == 0xFF)
+        {
+            _mm512_storeu_pd(alpha + ant_i,
+                    _mm512_mask_i32gather_pd(zero, all_lanes,
+                        _mm512_maskz_cvtpd_epi32(all_lanes, level_r),
+                        eff.table, 8));
+        }
+        else
+        {
+            for (int lane = 0; lane < 8; ++lane)
+            {
+                alpha[ant_i + lane] = efficiency_eval(eff, experience[ant_i + lane]);
+            }
+        }
+    }
+
+    for (; ant_i < n; ++ant_i)
+    {
+        update_worker_task(ant_i, task, curr_act, learn, forget,
+                threshold, experience, alpha, step_gain, step_lose, eff);
+    }
+}
+
+#endif
+
+// choose the widest kernel the cpu supports
+inline update_task_kernel select_update_task_kernel()
+{
+#ifdef WORKER_KERNELS_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        return update_task_avx512;
+    }
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return update_task_avx2;
+    }
+#endif
+
+    return update_task_scalar;
+}
+
+inline const char * update_task_kernel_name(update_task_kernel kernel)
+{
+#ifdef WORKER_KERNELS_X86
+    if (kernel == update_task_avx512)
+    {
+        return "avx512";
+    }
+
+    if (kernel == update_task_avx2)
+    {
+        return "avx2";
+    }
+#endif
+
+    return "scalar";
+}
+
+#endif
@@ -1,100 +1,242 @@
-#include <vector>
-#include <cmath>
-#include <iostream>
-#include <stdlib.h>
-#include <fstream>
-#include <cassert>
-#include <algorithm>
-#include <gsl/gsl_rng.h>
-#include <gsl/gsl_randist.h>
-
-using namespace std;
-
-
-//Random number generator 
-// see http://www.gnu.org/software/gsl/manual/html_node/Random-Number-Generation.html#Random-Number-Generation 
-gsl_rng_type const * T; // gnu scientific library rng type
-gsl_rng *rng_global; // gnu scientific rng 
-
-//Definining parameters
-struct Params
-{
-	double A; //Deterministic factor
-	double B; //Stochastic factor
-	int maxtime; //timesteps per generation
-	int genspercycle; //Generations per environmental cycle
-	int randommax; //Maximum value of positive random number
-	int seed;
-  double delta;
-  int gensdone = 0; //Generations completed
-  int stepsdone = 0; //Timesteps completed in current generation
- 
- //Function to read in parameters via stream
- istream & InitParams(istream & inp);
-};
-
-
-// A stream that reads in the parameter file
-istream & Params::InitParams(istream & in)
-{
-	in >> A //Deterministic factor
-		>> B //Stochastic factor
-		>> maxtime //timesteps per generation
-		>> genspercycle //Generations per environmental cycle
-		>> randommax //Maximum value of positive random number
-		>> seed;
-   return in;
-};
-
-// Diagnostic function: prints the results of the stream to verify that it performed correctly.
-void ShowParams(Params & Par)
-{
-	cout << "Deterministic Factor " << Par.A << endl;
-	cout << "Stochastic Factor " << Par.B << endl;
-	cout << "Timesteps per Generation " << Par.maxtime << endl;
-	cout << "Generations per Cycle " << Par.genspercycle << endl;
-	cout << "Maximum Random Number " << Par.randommax << endl;
-	cout << "Seed " << Par.seed << endl;
-};
-
-// Performs stochastic sine equation (Botero et al. 2015)
-void Stochsine(Params & Par)
-{
-	Par.delta = Par.A  * sin((2 *
-
-		//pi
-		3.14159265358979323846 * 
-    
-    //Calculate cumulative timesteps
-    ((Par.maxtime*Par.gensdone)+Par.stepsdone)
-    
-    ) / Par.maxtime* Par.genspercycle)
-		+ Par.B * 
-    
-    //Random number between 0 and randdommax
-    gsl_rng_uniform_pos(rng_global) * Par.randommax;
-}
-
-int main()
-{
-	//Load up the parameters and print them
-	Params myPars;
-	ifstream inp("env_params.txt");
-	myPars.InitParams(inp);
-	ShowParams(myPars);
-
-	// set up the random number generators from the gnu gsl library
-	gsl_rng_env_setup();
-	T = gsl_rng_default;
- 
-	rng_global = gsl_rng_alloc(T);
-	gsl_rng_set(rng_global, myPars.seed);
-
-	// Run the formula
-	Stochsine(myPars);
-
-	// Print delta
-		cout << "Delta: " << myPars.delta << endl;
-
-	return 0;
-}
\ No newline at end of file
+// test of the environment generator of the simulations (environment.h):
+// compares the tables it generates with the stochastic sine evaluated
+// one timestep and one random number at a time, checks that tables
+// are reproducible and that they survive being written and read back
+
+#include <vector>
+#include <cmath>
+#include <iostream>
+#include <stdlib.h>
+#include <fstream>
+#include <sstream>
+#include "environment.h"
+
+using namespace std;
+
+//Definining parameters
+struct Params
+{
+	double A; //Deterministic factor
+	double B; //Stochastic factor
+	int maxtime; //timesteps per generation
+	double genspercycle; //Generations per environmental cycle
+	int tasks; //number of tasks
+	int seed;
+
+ //Function to read in parameters via stream
+ istream & InitParams(istream & inp);
+};
+
+
+// A stream that reads in the parameter file
+istream & Params::InitParams(istream & in)
+{
+	in >> A //Deterministic factor
+		>> B //Stochastic factor
+		>> maxtime //timesteps per generation
+		>> genspercycle //Generations per environmental cycle
+		>> tasks //number of tasks
+		>> seed;
+   return in;
+};
+
+// Diagnostic function: prints the results of the stream to verify that it performed correctly.
+void ShowParams(Params & Par)
+{
+	cout << "Deterministic Factor " << Par.A << endl;
+	cout << "Stochastic Factor " << Par.B << endl;
+	cout << "Timesteps per Generation " << Par.maxtime << endl;
+	cout << "Generations per Cycle " << Par.genspercycle << endl;
+	cout << "Tasks " << Par.tasks << endl;
+	cout << "Seed " << Par.seed << endl;
+};
+
+int failures = 0;
+
+void Check(bool ok, string what)
+{
+	cout << (ok ? "ok     " : "FAILED ") << what << endl;
+
+	if (!ok)
+	{
+		++failures;
+	}
+}
+
+// baseline of each task: 1, 2, ...
+vector <double> Baseline(Params & Par)
+{
+	vector <double> baseline;
+
+	for (int task_i = 0; task_i < Par.tasks; ++task_i)
+	{
+		baseline.push_back(task_i + 1);
+	}
+
+	return baseline;
+}
+
+void Generate(Params & Par, environment & env, int generation)
+{
+	environment_generate(env, Baseline(Par), Par.A, Par.B,
+			Par.maxtime, Par.genspercycle,
+			Par.seed, generation);
+}
+
+// the stochastic sine (Botero et al. 2015) of one task at one timestep,
+// with the next random number of the stream
+double Stochsine(Params & Par, double baseline, int gensdone, int stepsdone,
+		philox_rng & rng_environment)
+{
+	return baseline + (Par.A * sin((2 *
+
+		//pi
+		M_PI *
+
+		//Calculate cumulative timesteps
+		((Par.maxtime * (double) gensdone) + stepsdone)
+
+		) / Par.maxtime * Par.genspercycle))
+		+ (Par.B *
+
+		//Random number between -1 and 1
+		((philox_rng_uniform_pos(rng_environment) * 2) - 1));
+}
+
+// the generated table of a generation equals the stochastic sine
+// evaluated one timestep at a time
+bool Matches_Stochsine(Params & Par, environment & env, int generation)
+{
+	vector <double> baseline = Baseline(Par);
+
+	philox_rng rng_environment;
+	philox_rng_set(rng_environment, Par.seed, ENVIRONMENT_RNG_PURPOSE, generation, 0);
+
+	for (int k = 0; k < Par.maxtime; ++k)
+	{
+		for (int task_i = 0; task_i < Par.tasks; ++task_i)
+		{
+			double delta = Stochsine(Par, baseline[task_i], generation, k, rng_environment);
+
+			if (environment_step(env, k)[task_i] != delta)
+			{
+				cout << "generation " << generation << " timestep " << k
+					<< " task " << task_i << ": " << environment_step(env, k)[task_i]
+					<< " instead of " << delta << endl;
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+int main()
+{
+	//Load up the parameters and print them
+	Params myPars;
+	ifstream inp("env_params.txt");
+
+	if (!myPars.InitParams(inp))
+	{
+		cout << "error: cannot read env_params.txt" << endl;
+		exit(1);
+	}
+
+	ShowParams(myPars);
+
+	int generations = 3;
+
+	environment env;
+
+	// generated tables against the formula
+	bool matches = true;
+
+	for (int g = 0; g < generations; ++g)
+	{
+		Generate(myPars, env, g);
+		matches = matches && Matches_Stochsine(myPars, env, g);
+	}
+
+	Check(matches, "tables equal the stochastic sine");
+
+	// noise stays within B of the sine
+	Generate(myPars, env, 0);
+
+	bool within = true;
+	double mean_noise = 0;
+
+	for (int k = 0; k < myPars.maxtime; ++k)
+	{
+		for (int task_i = 0; task_i < myPars.tasks; ++task_i)
+		{
+			double noise = environment_step(env, k)[task_i] - (task_i + 1) - env.wave[k];
+
+			within = within && fabs(noise) <= myPars.B;
+			mean_noise += noise / (myPars.maxtime * myPars.tasks);
+		}
+	}
+
+	Check(within, "noise within B");
+	cout << "mean noise " << mean_noise << endl;
+
+	// reproducible, and different in another generation
+	environment again;
+	Generate(myPars, again, 0);
+	Check(again.delta == env.delta, "same table when generated again");
+
+	Generate(myPars, again, 1);
+	Check(again.delta != env.delta, "different table in the next generation");
+
+	// written and read back
+	stringstream file;
+
+	for (int g = 0; g < generations; ++g)
+	{
+		Generate(myPars, env, g);
+		environment_write(file, env);
+	}
+
+	bool replayed = true;
+
+	for (int g = 0; g < generations; ++g)
+	{
+		Generate(myPars, env, g);
+		replayed = replayed
+			&& environment_read(file, again, myPars.tasks, myPars.maxtime, g)
+			&& again.delta == env.delta;
+	}
+
+	Check(replayed, "tables read back exactly");
+
+	Check(!environment_read(file, again, myPars.tasks, myPars.maxtime, generations),
+			"reading beyond the last table fails");
+
+	file.clear();
+	file.seekg(0);
+	Check(!environment_read(file, again, myPars.tasks, myPars.maxtime, 1),
+			"reading the table of another generation fails");
+
+	// Print the first deltas
+	Generate(myPars, env, 0);
+
+	for (int k = 0; k < 5 && k < myPars.maxtime; ++k)
+	{
+		cout << "Delta " << k << ":";
+
+		for (int task_i = 0; task_i < myPars.tasks; ++task_i)
+		{
+			cout << " " << environment_step(env, k)[task_i];
+		}
+
+		cout << endl;
+	}
+
+	if (failures > 0)
+	{
+		cout << failures << " checks failed" << endl;
+		return 1;
+	}
+
+	return 0;
+}